@@ -0,0 +1,68 @@
+#define _GNU_SOURCE // sync_file_range
+#include <cache.h>
+#include <stats.h>
+#include <fcntl.h>
+
+bool cache_neutral = false;
+
+/*!
+ * @brief cache_set_neutral enables or disables the cache-neutral mode
+ * @param enabled is true to drop the pages read and written by the backup from the page cache
+ */
+void cache_set_neutral(bool enabled) {
+    cache_neutral = enabled;
+}
+
+/*!
+ * @brief cache_advise_sequential tells the kernel that a file will be read once, from start to end
+ * @param fd is the file descriptor
+ */
+void cache_advise_sequential(int fd) {
+    if (cache_neutral) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        STATS_ADD(syscalls, 1);
+    }
+}
+
+/*!
+ * @brief cache_drop_read drops a range that was read from the page cache
+ * Clean pages are dropped at once.
+ * @param fd is the file descriptor
+ * @param offset is the start of the range
+ * @param length is the length of the range, 0 for the end of the file
+ */
+void cache_drop_read(int fd, off_t offset, off_t length) {
+    if (cache_neutral) {
+        posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        STATS_ADD(syscalls, 1);
+    }
+}
+
+/*!
+ * @brief cache_start_writeback starts the writeback of a written range without waiting for it
+ * @param fd is the file descriptor
+ * @param offset is the start of the range
+ * @param length is the length of the range
+ */
+void cache_start_writeback(int fd, off_t offset, off_t length) {
+    if (cache_neutral) {
+        sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
+        STATS_ADD(syscalls, 1);
+    }
+}
+
+/*!
+ * @brief cache_drop_written drops a range that was written from the page cache
+ * Dirty pages cannot be dropped, so the writeback of the range is waited for first. Callers start the
+ * writeback of a chunk with cache_start_writeback and drop the previous one, so that the disk stays busy.
+ * @param fd is the file descriptor
+ * @param offset is the start of the range
+ * @param length is the length of the range, 0 for the end of the file
+ */
+void cache_drop_written(int fd, off_t offset, off_t length) {
+    if (cache_neutral) {
+        sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+        STATS_ADD(syscalls, 2);
+    }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+// In cache-neutral mode, I/O is done by chunks of this size and each chunk is dropped from the page cache once consumed
+#define CACHE_CHUNK_SIZE (8 * 1024 * 1024)
+
+extern bool cache_neutral;
+
+void cache_set_neutral(bool enabled);
+void cache_advise_sequential(int fd);
+void cache_drop_read(int fd, off_t offset, off_t length);
+void cache_start_writeback(int fd, off_t offset, off_t length);
+void cache_drop_written(int fd, off_t offset, off_t length);
@@ -0,0 +1,367 @@
+#include <chunkstore.h>
+#include <defines.h>
+#include <utility.h>
+#include <stats.h>
+#include <trace.h>
+#include <ratelimit.h>
+#include <cache.h>
+#include <metadata.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+// Lecture de la source par blocs, les morceaux ne sont jamais plus grands
+#define CHUNKSTORE_READ_SIZE (4 * CHUNKSTORE_MAX_SIZE)
+
+static char store_root[PATH_SIZE];
+static uint64_t gear[256];
+// Identifiants déjà présents dans le magasin (vus pendant cette exécution) : évite un stat par morceau répété
+static uint8_t (*known_ids)[CHUNKSTORE_ID_SIZE] = NULL;
+static size_t known_capacity = 0;
+static size_t known_count = 0;
+
+/*!
+ * @brief chunkstore_open prepares the chunk store of a destination
+ * @param destination is the destination root
+ * @return 0 in case of success, -1 else
+ */
+int chunkstore_open(char *destination) {
+    if (concat_path(store_root, destination, CHUNKSTORE_DIRECTORY) == NULL) {
+        return -1;
+    }
+    STATS_ADD(syscalls, 1);
+    if (mkdir(store_root, 0755) == -1 && errno != EEXIST) {
+        perror("Erreur lors de la création du magasin de morceaux");
+        return -1;
+    }
+    // Table du hachage roulant (gear), fixe : les coupures ne dépendent que du contenu
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (int i=0; i<256; ++i) {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        gear[i] = z ^ (z >> 31);
+    }
+    known_capacity = 4096;
+    known_count = 0;
+    known_ids = calloc(known_capacity, CHUNKSTORE_ID_SIZE);
+    return known_ids == NULL ? -1 : 0;
+}
+
+/*!
+ * @brief find_known returns the slot of a chunk id in the known ids table, or the free slot where to insert it
+ * The ids are SHA-256 digests, their first bytes are already uniformly distributed.
+ */
+static uint8_t *find_known(const uint8_t *id) {
+    static const uint8_t empty[CHUNKSTORE_ID_SIZE] = {0};
+    size_t index;
+    memcpy(&index, id, sizeof(index));
+    index &= known_capacity - 1;
+    while (memcmp(known_ids[index], empty, CHUNKSTORE_ID_SIZE) != 0 && memcmp(known_ids[index], id, CHUNKSTORE_ID_SIZE) != 0) {
+        index = (index + 1) & (known_capacity - 1);
+    }
+    return known_ids[index];
+}
+
+/*!
+ * @brief remember_id adds a chunk id to the known ids table
+ */
+static void remember_id(const uint8_t *id) {
+    if (2 * (known_count + 1) > known_capacity) {
+        uint8_t (*old_ids)[CHUNKSTORE_ID_SIZE] = known_ids;
+        size_t old_capacity = known_capacity;
+        known_ids = calloc(2 * old_capacity, CHUNKSTORE_ID_SIZE);
+        if (known_ids == NULL) {
+            known_ids = old_ids; // Table pleine à moitié : elle reste utilisable, sans nouvel identifiant
+            return;
+        }
+        known_capacity = 2 * old_capacity;
+        static const uint8_t empty[CHUNKSTORE_ID_SIZE] = {0};
+        for (size_t i=0; i<old_capacity; ++i) {
+            if (memcmp(old_ids[i], empty, CHUNKSTORE_ID_SIZE) != 0) {
+                memcpy(find_known(old_ids[i]), old_ids[i], CHUNKSTORE_ID_SIZE);
+            }
+        }
+        free(old_ids);
+    }
+    uint8_t *slot = find_known(id);
+    if (memcmp(slot, id, CHUNKSTORE_ID_SIZE) != 0) {
+        memcpy(slot, id, CHUNKSTORE_ID_SIZE);
+        known_count++;
+    }
+}
+
+/*!
+ * @brief chunk_path builds the path of a chunk in the store, and creates its fan-out directory if asked
+ * @return 0 in case of success, -1 else
+ */
+static int chunk_path(const uint8_t *id, char *path, bool create_directory) {
+    char hex[2 * CHUNKSTORE_ID_SIZE + 1];
+    for (int i=0; i<CHUNKSTORE_ID_SIZE; ++i) {
+        snprintf(hex + 2 * i, 3, "%02x", id[i]);
+    }
+    int length = snprintf(path, PATH_SIZE, "%s/%.2s", store_root, hex);
+    if (create_directory && mkdir(path, 0755) == -1 && errno != EEXIST) {
+        return -1;
+    }
+    return snprintf(path + length, PATH_SIZE - length, "/%s", hex + 2) < PATH_SIZE - length ? 0 : -1;
+}
+
+/*!
+ * @brief store_chunk writes a chunk into the store, unless it is already there
+ * Chunks are written into a temporary file then renamed, so a chunk in the store is always complete.
+ * @param id is the chunk id
+ * @param data is the content of the chunk
+ * @param length is the length of the chunk
+ * @return 0 in case of success, -1 else
+ */
+static int store_chunk(const uint8_t *id, const uint8_t *data, size_t length) {
+    if (memcmp(find_known(id), id, CHUNKSTORE_ID_SIZE) == 0) {
+        STATS_ADD(chunks_reused, 1);
+        return 0;
+    }
+    char path[PATH_SIZE], temporary_path[PATH_SIZE];
+    struct stat info;
+    STATS_ADD(syscalls, 1);
+    if (chunk_path(id, path, false) == 0 && stat(path, &info) == 0) {
+        remember_id(id);
+        STATS_ADD(chunks_reused, 1);
+        return 0;
+    }
+    if (chunk_path(id, path, true) == -1 || snprintf(temporary_path, sizeof(temporary_path), "%s.%d.tmp", path, getpid()) >= PATH_SIZE) {
+        return -1;
+    }
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    STATS_ADD(syscalls, 1);
+    if (fd == -1) {
+        return -1;
+    }
+    for (size_t written = 0; written < length; ) {
+        ssize_t result = write(fd, data + written, length - written);
+        STATS_ADD(syscalls, 1);
+        if (result == -1) {
+            close(fd);
+            unlink(temporary_path);
+            return -1;
+        }
+        written += result;
+    }
+    close(fd);
+    STATS_ADD(syscalls, 1);
+    if (rename(temporary_path, path) == -1) {
+        unlink(temporary_path);
+        return -1;
+    }
+    remember_id(id);
+    STATS_ADD(chunks_stored, 1);
+    STATS_ADD(bytes_copied, length);
+    return 0;
+}
+
+/*!
+ * @brief next_cut finds the end of the next chunk with a gear rolling hash
+ * A cut happens where the hash has its low bits at zero (one chance in CHUNKSTORE_AVERAGE_SIZE), so cuts
+ * move with the content: an insertion only changes the chunks around it.
+ * @param data is the data to chunk
+ * @param length is the length of the data
+ * @return the length of the next chunk
+ */
+static size_t next_cut(const uint8_t *data, size_t length) {
+    if (length <= CHUNKSTORE_MIN_SIZE) {
+        return length;
+    }
+    size_t limit = length < CHUNKSTORE_MAX_SIZE ? length : CHUNKSTORE_MAX_SIZE;
+    const uint64_t mask = (uint64_t)(CHUNKSTORE_AVERAGE_SIZE - 1) << 48; // Bits de poids fort, les mieux mélangés
+    uint64_t hash = 0;
+    for (size_t i=CHUNKSTORE_MIN_SIZE; i<limit; ++i) {
+        hash = (hash << 1) + gear[data[i]];
+        if ((hash & mask) == 0) {
+            return i + 1;
+        }
+    }
+    return limit;
+}
+
+/*!
+ * @brief chunkstore_is_current tests if the recipe of a file matches its source (size, date and mode)
+ * @param recipe_path is the path of the recipe in the destination
+ * @param source_entry is the source entry
+ * @return true if the recipe is up to date, false else
+ */
+bool chunkstore_is_current(const char *recipe_path, files_list_entry_t *source_entry) {
+    chunkstore_recipe_header_t header;
+    int fd = open(recipe_path, O_RDONLY);
+    STATS_ADD(syscalls, 1);
+    if (fd == -1) {
+        return false;
+    }
+    bool current = read(fd, &header, sizeof(header)) == sizeof(header)
+        && memcmp(header.magic, CHUNKSTORE_RECIPE_MAGIC, sizeof(CHUNKSTORE_RECIPE_MAGIC)) == 0
+        && header.version == CHUNKSTORE_RECIPE_VERSION
+        && header.size == source_entry->size
+        && header.mtime_ns == (int64_t)source_entry->mtime.tv_sec * 1000000000LL + source_entry->mtime.tv_nsec
+        && header.mode == (uint32_t)source_entry->mode;
+    STATS_ADD(syscalls, 2);
+    close(fd);
+    return current;
+}
+
+/*!
+ * @brief chunk_file splits an open file into chunks and stores the new ones
+ * The file is read by CHUNKSTORE_READ_SIZE blocks; the data not chunked yet stays at the head of the buffer.
+ * @param source_fd is the file descriptor of the source
+ * @param references receives the array of the chunks references (to free by the caller)
+ * @param references_count receives the number of chunks
+ * @return 0 in case of success, -1 else
+ */
+static int chunk_file(int source_fd, chunkstore_reference_t **references, size_t *references_count) {
+    uint8_t *buffer = malloc(CHUNKSTORE_READ_SIZE);
+    EVP_MD_CTX *context = EVP_MD_CTX_new();
+    size_t references_capacity = 0;
+    *references = NULL;
+    *references_count = 0;
+    int result = buffer == NULL || context == NULL ? -1 : 0;
+
+    size_t filled = 0;
+    off_t offset = 0;
+    bool end_of_file = false;
+    while (result == 0 && (!end_of_file || filled > 0)) {
+        if (!end_of_file && filled < CHUNKSTORE_MAX_SIZE) {
+            RATELIMIT(CHUNKSTORE_READ_SIZE - filled);
+            ssize_t bytes_read = read(source_fd, buffer + filled, CHUNKSTORE_READ_SIZE - filled);
+            STATS_ADD(syscalls, 1);
+            if (bytes_read == -1) {
+                perror("Erreur de lecture du fichier");
+                result = -1;
+                break;
+            }
+            cache_drop_read(source_fd, offset, bytes_read);
+            offset += bytes_read;
+            filled += bytes_read;
+            end_of_file = bytes_read == 0;
+            continue;
+        }
+        size_t length = next_cut(buffer, filled);
+        if (*references_count == references_capacity) {
+            references_capacity = references_capacity ? 2 * references_capacity : 64;
+            chunkstore_reference_t *new_references = realloc(*references, references_capacity * sizeof(chunkstore_reference_t));
+            if (new_references == NULL) {
+                result = -1;
+                break;
+            }
+            *references = new_references;
+        }
+        chunkstore_reference_t *reference = &(*references)[(*references_count)++];
+        memset(reference, 0, sizeof(chunkstore_reference_t));
+        reference->length = (uint32_t)length;
+        EVP_DigestInit_ex(context, EVP_sha256(), NULL);
+        EVP_DigestUpdate(context, buffer, length);
+        EVP_DigestFinal_ex(context, reference->id, NULL);
+        if (store_chunk(reference->id, buffer, length) == -1) {
+            perror("Erreur lors de l'écriture d'un morceau");
+            result = -1;
+            break;
+        }
+        memmove(buffer, buffer + length, filled - length);
+        filled -= length;
+    }
+    EVP_MD_CTX_free(context);
+    free(buffer);
+    return result;
+}
+
+/*!
+ * @brief write_recipe writes the recipe of a file, into a temporary file then renamed (a recipe is always complete)
+ * @param source_entry is the source entry
+ * @param recipe_path is the path of the recipe in the destination
+ * @param references is the array of the chunks references
+ * @param references_count is the number of chunks
+ * @return 0 in case of success, -1 else
+ */
+static int write_recipe(files_list_entry_t *source_entry, const char *recipe_path, chunkstore_reference_t *references, size_t references_count) {
+    char temporary_path[PATH_SIZE];
+    if (snprintf(temporary_path, sizeof(temporary_path), "%s.tmp", recipe_path) >= PATH_SIZE) {
+        return -1;
+    }
+    chunkstore_recipe_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHUNKSTORE_RECIPE_MAGIC, sizeof(CHUNKSTORE_RECIPE_MAGIC));
+    header.version = CHUNKSTORE_RECIPE_VERSION;
+    header.mode = (uint32_t)source_entry->mode;
+    header.size = source_entry->size;
+    header.mtime_ns = (int64_t)source_entry->mtime.tv_sec * 1000000000LL + source_entry->mtime.tv_nsec;
+    header.chunks_count = references_count;
+
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    STATS_ADD(syscalls, 1);
+    if (fd == -1) {
+        return -1;
+    }
+    ssize_t references_size = references_count * sizeof(chunkstore_reference_t);
+    STATS_ADD(syscalls, 3);
+    bool written = write(fd, &header, sizeof(header)) == sizeof(header)
+        && write(fd, references, references_size) == references_size;
+    if (written) {
+        metadata_apply_fd(fd, source_entry->mode | S_IRUSR | S_IWUSR, &source_entry->mtime);
+    }
+    close(fd);
+    STATS_ADD(syscalls, 1);
+    if (!written || rename(temporary_path, recipe_path) == -1) {
+        unlink(temporary_path);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief chunkstore_store_file splits a file into chunks, stores the new ones and writes the recipe of the file
+ * @param source_entry is the source entry
+ * @param recipe_path is the path of the recipe in the destination
+ * @return 0 in case of success, -1 else
+ */
+int chunkstore_store_file(files_list_entry_t *source_entry, const char *recipe_path) {
+    uint64_t copy_start = stats_begin();
+    TRACE_BEGIN("chunk", "sync");
+    int source_fd = open(source_entry->path_and_name, O_RDONLY);
+    STATS_ADD(syscalls, 1);
+    if (source_fd == -1) {
+        perror("Erreur dans l'ouverture du fichier");
+        STATS_ADD(errors, 1);
+        TRACE_END("chunk", "sync");
+        stats_end(PHASE_COPY, copy_start);
+        return -1;
+    }
+    cache_advise_sequential(source_fd);
+
+    chunkstore_reference_t *references = NULL;
+    size_t references_count = 0;
+    int result = chunk_file(source_fd, &references, &references_count);
+    close(source_fd);
+    if (result == 0 && write_recipe(source_entry, recipe_path, references, references_count) == -1) {
+        perror("Erreur lors de l'écriture de la recette");
+        result = -1;
+    }
+    free(references);
+    if (result == 0) {
+        STATS_ADD(files_copied, 1);
+    } else {
+        STATS_ADD(errors, 1);
+    }
+    TRACE_END("chunk", "sync");
+    stats_end(PHASE_COPY, copy_start);
+    return result;
+}
+
+/*!
+ * @brief chunkstore_close frees the known ids table
+ */
+void chunkstore_close(void) {
+    free(known_ids);
+    known_ids = NULL;
+    known_capacity = known_count = 0;
+}
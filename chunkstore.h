@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <files-list.h>
+
+// Directory of the chunks, inside the destination: .chunks/<2 hex digits>/<remaining hex digits>
+#define CHUNKSTORE_DIRECTORY ".chunks"
+#define CHUNKSTORE_RECIPE_MAGIC "LP25RCP"
+#define CHUNKSTORE_RECIPE_VERSION 1
+// Content-defined chunking bounds; the average chunk size is CHUNKSTORE_AVERAGE_SIZE (power of 2)
+#define CHUNKSTORE_MIN_SIZE (16 * 1024)
+#define CHUNKSTORE_AVERAGE_SIZE (64 * 1024)
+#define CHUNKSTORE_MAX_SIZE (256 * 1024)
+#define CHUNKSTORE_ID_SIZE 32 // SHA-256
+
+// A file of the destination is a recipe: this header, then chunks_count chunk references
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t mode;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t chunks_count;
+} chunkstore_recipe_header_t;
+
+typedef struct {
+    uint8_t id[CHUNKSTORE_ID_SIZE];
+    uint32_t length;
+    uint32_t padding;
+} chunkstore_reference_t;
+
+int chunkstore_open(char *destination);
+bool chunkstore_is_current(const char *recipe_path, files_list_entry_t *source_entry);
+int chunkstore_store_file(files_list_entry_t *source_entry, const char *recipe_path);
+void chunkstore_close(void);
@@ -4,8 +4,13 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <utility.h>
+#include <filter.h>
+#include <remote.h>
+#include <pack.h>
 
-typedef enum {DATE_SIZE_ONLY, NO_PARALLEL} long_opt_values;
+typedef enum {DATE_SIZE_ONLY, NO_PARALLEL, STATS_REPORT = 0x100, PROGRESS, PROGRESS_FD, TRACE, LAZY_MD5, MANIFEST, VERIFY_MANIFEST, MEMORY_LIMIT, DURABILITY, DETECT_MOVES, BWLIMIT, IOPS_LIMIT, IO_IDLE, CACHE_NEUTRAL, EXCLUDE, INCLUDE, EXCLUDE_FROM, JOURNAL, SNAPSHOT, CHUNK_STORE, SERVE, VERIFY, DISK_ORDER, PACK_SMALL} long_opt_values;
 
 /*!
  * @brief function display_help displays a brief manual for the program usage
@@ -13,13 +18,39 @@ typedef enum {DATE_SIZE_ONLY, NO_PARALLEL} long_opt_values;
  * This function is provided with its code, you don't have to implement nor modify it.
  */
 void display_help(char *my_name) {
-    printf("%s [options] source_dir destination_dir\n", my_name);
-    printf("Options: \t-n <processes count>\tnumber of processes for file calculations\n");
+    printf("%s [options] source_dir destination_dir [destination_dir...]\n", my_name);
+    printf("%s [options] source_dir tcp://host:port|unix://socket_path\n", my_name);
+    printf("%s [options] --serve <tcp://host:port|unix://socket_path> destination_dir\n", my_name);
+    printf("Options: \t-n <processes count|auto>\tnumber of processes for file calculations (auto: from cores and devices, adapted to the throughput)\n");
     printf("         \t-h display help (this text)\n");
     printf("         \t--date_size_only disables MD5 calculation for files\n");
+    printf("         \t--lazy-md5 compares MD5 sums, computed only for files whose size and date match on both sides\n");
+    printf("         \t--manifest reads the destination from its manifest instead of listing it, and updates the manifest\n");
+    printf("         \t--verify-manifest same as --manifest, but checks each manifest entry against the destination first\n");
+    printf("         \t--memory-limit <size> bounds the memory used for lists (e.g. 512M), sorting them on disk\n");
+    printf("         \t--durability <none|batch|file> flushes copies: never, with grouped syncfs, or fdatasync per file\n");
+    printf("         \t--detect-moves renames files moved in the source inside the destination instead of copying them\n");
+    printf("         \t--bwlimit <size> limits reads and writes of all the processes to size bytes per second (K, M, G suffixes)\n");
+    printf("         \t--iops-limit <count> limits the I/O operations of all the processes to count per second\n");
+    printf("         \t--io-idle runs the backup in the idle I/O scheduling class\n");
+    printf("         \t--cache-neutral drops the files read and written from the page cache once consumed\n");
+    printf("         \t--exclude <pattern> skips the entries matching pattern (excluded directories are not scanned)\n");
+    printf("         \t--include <pattern> keeps the entries matching pattern, the first matching rule wins\n");
+    printf("         \t--exclude-from <file> reads patterns from file (one per line, \"+ pattern\" to include)\n");
+    printf("         \t--journal records the progress in the destination, so that an interrupted run is resumed\n");
+    printf("         \t--snapshot writes each run into a new dated directory of the destination, unchanged files being hard links to the previous one\n");
+    printf("         \t--chunk-store stores files as lists of deduplicated content-defined chunks in the destination\n");
+    printf("         \t--verify hashes files while copying them, then rereads the copies from disk (page cache bypassed) to check them\n");
+    printf("         \t--disk-order hashes and copies files in the order of their data on disk (for rotating disks)\n");
+    printf("         \t--pack-small <size> stores files smaller than size (at most 4M) in append-only pack files of the destination, with an index\n");
+    printf("         \t--serve <address> receives synchronizations from senders into destination_dir (tcp://:port listens on 127.0.0.1 only; host * listens on all interfaces and accepts writes from any peer, without authentication)\n");
     printf("         \t--no-parallel disables parallel computing (cancels values of option -n)\n");
     printf("         \t--dry-run lists the changes that would need to be synchronized but doesn't perform them\n");
     printf("         \t-v enables verbose mode\n");
+    printf("         \t--stats[=<file>] writes a JSON report of phase timers and counters at exit (stdout by default)\n");
+    printf("         \t--progress displays a live progress line (entries, bytes hashed/copied, rates, ETA) on stderr\n");
+    printf("         \t--progress-fd <fd> writes progress as JSON lines on the given file descriptor\n");
+    printf("         \t--trace <file> records a Chrome trace (perfetto) of all processes into file\n");
 }
 
 /*!
@@ -35,10 +66,34 @@ void init_configuration(configuration_t *the_config) {
     strcpy(the_config->source, "src_default");
     strcpy(the_config->destination, "dst_default");
     the_config->processes_count = 1;
+    the_config->auto_processes = false;
     the_config->is_parallel = false;
     the_config->uses_md5 = false;
+    the_config->lazy_md5 = false;
+    the_config->use_manifest = false;
+    the_config->verify_manifest = false;
+    the_config->memory_limit = 0;
+    the_config->durability = DURABILITY_NONE;
+    the_config->detect_moves = false;
+    the_config->bwlimit = 0;
+    the_config->iops_limit = 0;
+    the_config->io_idle = false;
+    the_config->cache_neutral = false;
+    the_config->extra_destinations_count = 0;
+    the_config->use_journal = false;
+    the_config->snapshot = false;
+    the_config->chunk_store = false;
+    the_config->serve_address[0] = '\0';
+    the_config->verify = false;
+    the_config->disk_order = false;
+    the_config->pack_threshold = 0;
     the_config->is_verbose = false;
     the_config->is_dry_run = false;
+    the_config->show_stats = false;
+    the_config->stats_path[0] = '\0';
+    the_config->show_progress = false;
+    the_config->progress_fd = -1;
+    the_config->trace_path[0] = '\0';
 }
 
 /*!
@@ -64,6 +119,30 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
             {"no-parallel", no_argument, NULL, 'y'},
             {"dry-run", no_argument, NULL, 'd'},
             {"verbose", no_argument, NULL, 'v'},
+            {"stats", optional_argument, NULL, STATS_REPORT},
+            {"progress", no_argument, NULL, PROGRESS},
+            {"progress-fd", required_argument, NULL, PROGRESS_FD},
+            {"trace", required_argument, NULL, TRACE},
+            {"lazy-md5", no_argument, NULL, LAZY_MD5},
+            {"manifest", no_argument, NULL, MANIFEST},
+            {"verify-manifest", no_argument, NULL, VERIFY_MANIFEST},
+            {"memory-limit", required_argument, NULL, MEMORY_LIMIT},
+            {"durability", required_argument, NULL, DURABILITY},
+            {"detect-moves", no_argument, NULL, DETECT_MOVES},
+            {"bwlimit", required_argument, NULL, BWLIMIT},
+            {"iops-limit", required_argument, NULL, IOPS_LIMIT},
+            {"io-idle", no_argument, NULL, IO_IDLE},
+            {"cache-neutral", no_argument, NULL, CACHE_NEUTRAL},
+            {"exclude", required_argument, NULL, EXCLUDE},
+            {"include", required_argument, NULL, INCLUDE},
+            {"exclude-from", required_argument, NULL, EXCLUDE_FROM},
+            {"journal", no_argument, NULL, JOURNAL},
+            {"snapshot", no_argument, NULL, SNAPSHOT},
+            {"chunk-store", no_argument, NULL, CHUNK_STORE},
+            {"serve", required_argument, NULL, SERVE},
+            {"verify", no_argument, NULL, VERIFY},
+            {"disk-order", no_argument, NULL, DISK_ORDER},
+            {"pack-small", required_argument, NULL, PACK_SMALL},
             {NULL, 0, NULL, 0}};
     
     int non_option_args_start = optind
@@ -71,17 +150,131 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
     while ((option = getopt_long(argc, argv, short_options, long_options, NULL)) != -1) {
         switch (option) {
             case 'n':
-                the_config->processes_count = (uint8_t)atoi(optarg);
+                if (strcmp(optarg, "auto") == 0) {
+                    the_config->auto_processes = true;
+                } else {
+                    char *end;
+                    long count = strtol(optarg, &end, 10);
+                    if (*end != '\0' || count < 1 || count > MAX_PROCESSES_COUNT) {
+                        fprintf(stderr, "Error: invalid processes count %s (1 to %d, or auto)\n", optarg, MAX_PROCESSES_COUNT);
+                        return -1;
+                    }
+                    the_config->processes_count = (uint16_t)count;
+                    the_config->auto_processes = false;
+                }
                 break;
             case 'h':
                 display_help(argv[0]);
                 return -1; // Terminer le programme après affichage de l'aide
             case 'x':
                 the_config->uses_md5 = false;
+                the_config->lazy_md5 = false;
+                break;
+            case LAZY_MD5:
+                the_config->uses_md5 = true;
+                the_config->lazy_md5 = true;
+                break;
+            case MANIFEST:
+                the_config->use_manifest = true;
+                break;
+            case VERIFY_MANIFEST:
+                the_config->use_manifest = true;
+                the_config->verify_manifest = true;
+                break;
+            case MEMORY_LIMIT: {
+                int64_t limit = parse_size(optarg);
+                if (limit <= 0) {
+                    fprintf(stderr, "Error: invalid memory limit %s\n", optarg);
+                    return -1;
+                }
+                the_config->memory_limit = (size_t)limit;
+                break;
+            }
+            case DURABILITY:
+                if (strcmp(optarg, "none") == 0) {
+                    the_config->durability = DURABILITY_NONE;
+                } else if (strcmp(optarg, "batch") == 0) {
+                    the_config->durability = DURABILITY_BATCH;
+                } else if (strcmp(optarg, "file") == 0) {
+                    the_config->durability = DURABILITY_FILE;
+                } else {
+                    fprintf(stderr, "Error: invalid durability mode %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case DETECT_MOVES:
+                the_config->detect_moves = true;
+                break;
+            case BWLIMIT: {
+                int64_t limit = parse_size(optarg);
+                if (limit <= 0) {
+                    fprintf(stderr, "Error: invalid bandwidth limit %s\n", optarg);
+                    return -1;
+                }
+                the_config->bwlimit = (uint64_t)limit;
+                break;
+            }
+            case IOPS_LIMIT: {
+                char *end;
+                long long limit = strtoll(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || limit <= 0) {
+                    fprintf(stderr, "Error: invalid IOPS limit %s\n", optarg);
+                    return -1;
+                }
+                the_config->iops_limit = (uint64_t)limit;
+                break;
+            }
+            case IO_IDLE:
+                the_config->io_idle = true;
+                break;
+            case CACHE_NEUTRAL:
+                the_config->cache_neutral = true;
+                break;
+            case EXCLUDE:
+            case INCLUDE:
+                if (filter_add_rule(optarg, option == INCLUDE) == -1) {
+                    fprintf(stderr, "Error: invalid pattern %s\n", optarg);
+                    return -1;
+                }
+                break;
+            case CHUNK_STORE:
+                the_config->chunk_store = true;
+                break;
+            case DISK_ORDER:
+                the_config->disk_order = true;
+                break;
+            case PACK_SMALL: {
+                int64_t threshold = parse_size(optarg);
+                if (threshold <= 0 || threshold > PACK_MAX_FILE_SIZE) {
+                    fprintf(stderr, "Error: invalid pack threshold %s\n", optarg);
+                    return -1;
+                }
+                the_config->pack_threshold = (uint64_t)threshold;
+                break;
+            }
+            case VERIFY:
+                the_config->verify = true;
+                break;
+            case SERVE:
+                strncpy(the_config->serve_address, optarg, sizeof(the_config->serve_address) - 1);
+                the_config->serve_address[sizeof(the_config->serve_address) - 1] = '\0';
+                break;
+            case SNAPSHOT:
+                the_config->snapshot = true;
+                break;
+            case JOURNAL:
+                the_config->use_journal = true;
+                break;
+            case EXCLUDE_FROM:
+                if (filter_load_file(optarg) == -1) {
+                    fprintf(stderr, "Error: invalid patterns file %s\n", optarg);
+                    return -1;
+                }
                 break;
             case 'y':
                 the_config->is_parallel = false;
                 the_config->processes_count = 1; // Réinitialiser le nombre de processus
+                the_config->auto_processes = false;
                 break;
             case 'd':
                 the_config->is_dry_run = true;
@@ -89,11 +282,46 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
             case 'v':
                 the_config->is_verbose = true;
                 break;
+            case STATS_REPORT:
+                the_config->show_stats = true;
+                if (optarg != NULL) {
+                    strncpy(the_config->stats_path, optarg, sizeof(the_config->stats_path) - 1);
+                    the_config->stats_path[sizeof(the_config->stats_path) - 1] = '\0';
+                }
+                break;
+            case PROGRESS:
+                the_config->show_progress = true;
+                break;
+            case PROGRESS_FD: {
+                char *end;
+                long fd = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || fd < 0 || fd > INT_MAX) {
+                    fprintf(stderr, "Error: invalid progress file descriptor %s\n", optarg);
+                    return -1;
+                }
+                the_config->progress_fd = (int)fd;
+                break;
+            }
+            case TRACE:
+                strncpy(the_config->trace_path, optarg, sizeof(the_config->trace_path) - 1);
+                the_config->trace_path[sizeof(the_config->trace_path) - 1] = '\0';
+                break;
             default:
                 return -1; // Option non reconnue
         }
     }
     
+    // Récepteur : le seul argument est la destination
+    if (the_config->serve_address[0] != '\0') {
+        if (optind + 1 != argc) {
+            fprintf(stderr, "Error: --serve takes a single destination directory\n");
+            return -1;
+        }
+        strncpy(the_config->destination, argv[optind], sizeof(the_config->destination) - 1);
+        the_config->destination[sizeof(the_config->destination) - 1] = '\0';
+        return 0;
+    }
+
     if (optind + 1 >= argc) {
         fprintf(stderr, "Error: Insufficient arguments for source and destination\n");
         return -1;
@@ -110,5 +338,21 @@ int set_configuration(configuration_t *the_config, int argc, char *argv[]) {
     strncpy(the_config->destination, argv[optind + 1], sizeof(the_config->destination) - 1);
     the_config->destination[sizeof(the_config->destination) - 1] = '\0';
 
+    // Destinations supplémentaires : la source n'est lue qu'une fois pour toutes
+    if (argc - optind - 2 > MAX_EXTRA_DESTINATIONS) {
+        fprintf(stderr, "Error: at most %d destinations\n", MAX_EXTRA_DESTINATIONS + 1);
+        return -1;
+    }
+    the_config->extra_destinations_count = 0;
+    for (int i = optind + 2; i < argc; i++) {
+        char *extra = the_config->extra_destinations[the_config->extra_destinations_count++];
+        strncpy(extra, argv[i], sizeof(the_config->extra_destinations[0]) - 1);
+        extra[sizeof(the_config->extra_destinations[0]) - 1] = '\0';
+    }
+    if (remote_is_address(the_config->destination) && the_config->extra_destinations_count > 0) {
+        fprintf(stderr, "Error: a remote destination must be the only destination\n");
+        return -1;
+    }
+
     return 0; // Succès
 }
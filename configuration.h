@@ -2,15 +2,48 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+typedef enum { DURABILITY_NONE, DURABILITY_BATCH, DURABILITY_FILE } durability_mode_t;
+
+// Destinations given after the first one (fan-out), each synchronized from a single read of the source
+#define MAX_EXTRA_DESTINATIONS 7
+// Upper bound of -n (and of the workers started by -n auto)
+#define MAX_PROCESSES_COUNT 1024
 
 typedef struct {
     char source[1024];
     char destination[1024];
-    uint8_t processes_count;
+    char extra_destinations[MAX_EXTRA_DESTINATIONS][1024];
+    uint8_t extra_destinations_count;
+    uint16_t processes_count;
+    bool auto_processes;
     bool is_parallel;
     bool uses_md5;
+    bool lazy_md5;
+    bool use_manifest;
+    bool verify_manifest;
+    size_t memory_limit;
+    durability_mode_t durability;
+    bool detect_moves;
+    uint64_t bwlimit;
+    uint64_t iops_limit;
+    bool io_idle;
+    bool cache_neutral;
+    bool use_journal;
+    bool snapshot;
+    bool chunk_store;
+    char serve_address[1024];
+    bool verify;
+    bool disk_order;
+    uint64_t pack_threshold;
 		bool is_verbose;
 		bool is_dry_run;
+    bool show_stats;
+    char stats_path[1024];
+    bool show_progress;
+    int progress_fd;
+    char trace_path[1024];
 } configuration_t;
 
 void init_configuration(configuration_t *the_config);
@@ -0,0 +1,166 @@
+#include <diskorder.h>
+#include <stats.h>
+#include <trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+
+bool diskorder_enabled = false;
+
+typedef struct {
+    files_list_entry_t *entry;
+    dev_t device;
+    uint64_t position; // Adresse physique du premier extent, ou numéro d'inode à défaut
+} disk_position_t;
+
+/*!
+ * @brief diskorder_enable enables the on-disk ordering of hash and copy work (--disk-order)
+ * @param enabled is true to enable it
+ */
+void diskorder_enable(bool enabled) {
+    diskorder_enabled = enabled;
+}
+
+/*!
+ * @brief physical_position returns the physical address of the first extent of a file (FIEMAP)
+ * Files without mapped extents (empty, inline) and filesystems without FIEMAP use their inode number:
+ * inodes are allocated close to their data on most filesystems, it is a fair approximation.
+ * @param entry is the entry of the file
+ * @return the position to sort the file by
+ */
+static uint64_t physical_position(files_list_entry_t *entry) {
+    int fd = open(entry->path_and_name, O_RDONLY);
+    STATS_ADD(syscalls, 1);
+    if (fd == -1) {
+        return entry->inode;
+    }
+    struct {
+        struct fiemap map;
+        struct fiemap_extent extent;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.map.fm_start = 0;
+    request.map.fm_length = FIEMAP_MAX_OFFSET;
+    request.map.fm_extent_count = 1;
+    uint64_t position = entry->inode;
+    STATS_ADD(syscalls, 2);
+    if (ioctl(fd, FS_IOC_FIEMAP, &request.map) == 0 && request.map.fm_mapped_extents > 0) {
+        position = request.extent.fe_physical;
+    }
+    close(fd);
+    return position;
+}
+
+/*!
+ * @brief compare_positions is the qsort comparison function for disk positions (device, then position)
+ */
+static int compare_positions(const void *lhd, const void *rhd) {
+    const disk_position_t *left = lhd, *right = rhd;
+    if (left->device != right->device) {
+        return left->device < right->device ? -1 : 1;
+    }
+    return left->position < right->position ? -1 : left->position > right->position;
+}
+
+/*!
+ * @brief diskorder_sort sorts entries by their position on disk, so that they are read in one sweep
+ * @param entries is the array of the entries to sort (files)
+ * @param count is the number of entries
+ * @return 0 in case of success, -1 else (the array is left unchanged)
+ */
+int diskorder_sort(files_list_entry_t **entries, size_t count) {
+    if (count < 2) {
+        return 0;
+    }
+    disk_position_t *positions = malloc(count * sizeof(disk_position_t));
+    if (positions == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    TRACE_BEGIN("disk_order", "sync");
+    for (size_t i=0; i<count; ++i) {
+        positions[i].entry = entries[i];
+        positions[i].device = entries[i]->device;
+        positions[i].position = physical_position(entries[i]);
+    }
+    qsort(positions, count, sizeof(disk_position_t), compare_positions);
+    for (size_t i=0; i<count; ++i) {
+        entries[i] = positions[i].entry;
+    }
+    TRACE_END("disk_order", "sync");
+    free(positions);
+    return 0;
+}
+
+/*!
+ * @brief diskorder_sort_list reorders a list to copy: directories first (in their order, parents before
+ * children), then files by their position on disk
+ * @param list is the list to reorder
+ * @return 0 in case of success, -1 else (the list is left unchanged)
+ */
+int diskorder_sort_list(files_list_t *list) {
+    size_t count = 0;
+    for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
+        count++;
+    }
+    if (count < 2) {
+        return 0;
+    }
+    files_list_entry_t **entries = malloc(count * sizeof(files_list_entry_t *));
+    if (entries == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    size_t directories_count = 0;
+    for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
+        if (cursor->entry_type == DOSSIER) {
+            entries[directories_count++] = cursor;
+        }
+    }
+    size_t files_count = directories_count;
+    for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
+        if (cursor->entry_type != DOSSIER) {
+            entries[files_count++] = cursor;
+        }
+    }
+    if (diskorder_sort(entries + directories_count, count - directories_count) == -1) {
+        free(entries);
+        return -1;
+    }
+    list->head = list->tail = NULL;
+    for (size_t i=0; i<count; ++i) {
+        entries[i]->next = NULL;
+        add_entry_to_tail(list, entries[i]);
+    }
+    free(entries);
+    return 0;
+}
+
+/*!
+ * @brief diskorder_prefetch asks the kernel to read ahead the next small files of a list, all at once
+ * The requests reach the I/O scheduler together, which serves them in one sweep of the disk instead of
+ * one seek per file. Large files are read sequentially anyway and are left out.
+ * @param first is the first entry of the batch
+ */
+void diskorder_prefetch(files_list_entry_t *first) {
+    int batched = 0;
+    for (files_list_entry_t *cursor = first; cursor != NULL && batched < DISKORDER_BATCH_FILES; cursor = cursor->next) {
+        if (cursor->entry_type != FICHIER || cursor->size == 0 || cursor->size > DISKORDER_SMALL_FILE_SIZE) {
+            continue;
+        }
+        int fd = open(cursor->path_and_name, O_RDONLY);
+        STATS_ADD(syscalls, 1);
+        if (fd == -1) {
+            continue;
+        }
+        posix_fadvise(fd, 0, cursor->size, POSIX_FADV_WILLNEED);
+        STATS_ADD(syscalls, 2);
+        close(fd);
+        batched++;
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <files-list.h>
+
+// Files under this size are read ahead together, a batch at a time, so that the disk serves them in one sweep
+#define DISKORDER_SMALL_FILE_SIZE (256 * 1024)
+#define DISKORDER_BATCH_FILES 64
+
+extern bool diskorder_enabled;
+
+void diskorder_enable(bool enabled);
+int diskorder_sort(files_list_entry_t **entries, size_t count);
+int diskorder_sort_list(files_list_t *list);
+void diskorder_prefetch(files_list_entry_t *first);
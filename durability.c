@@ -0,0 +1,127 @@
+#define _GNU_SOURCE // syncfs
+#include <durability.h>
+#include <stats.h>
+#include <trace.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <configuration.h>
+
+static durability_mode_t durability_mode = DURABILITY_NONE;
+static int destination_fds[1 + MAX_EXTRA_DESTINATIONS];
+static int destinations_count = 0;
+static uint64_t pending_files = 0;
+static uint64_t pending_bytes = 0;
+
+/*!
+ * @brief durability_init prepares the durability policy for the copy phase
+ * @param mode is the durability mode (none, batch or file)
+ * @param destination is the destination root, whose filesystem is synced
+ * @return 0 in case of success, -1 else
+ */
+int durability_init(durability_mode_t mode, char *destination) {
+    durability_mode = mode;
+    pending_files = 0;
+    pending_bytes = 0;
+    destinations_count = 0;
+    if (mode == DURABILITY_NONE) {
+        return 0;
+    }
+    if (durability_add_destination(destination) == -1) {
+        durability_mode = DURABILITY_NONE;
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief durability_add_destination adds a destination whose filesystem is synced with the first one (fan-out)
+ * @param destination is the destination root
+ * @return 0 in case of success, -1 else
+ */
+int durability_add_destination(char *destination) {
+    if (durability_mode == DURABILITY_NONE) {
+        return 0;
+    }
+    if (destinations_count == 1 + MAX_EXTRA_DESTINATIONS) {
+        return -1;
+    }
+    int fd = open(destination, O_RDONLY | O_DIRECTORY);
+    if (fd == -1) {
+        perror("Erreur lors de l'ouverture de la destination");
+        return -1;
+    }
+    destination_fds[destinations_count++] = fd;
+    return 0;
+}
+
+/*!
+ * @brief sync_destination flushes the whole destination filesystem with a single syncfs (one per destination)
+ * @return 0 in case of success, -1 else
+ */
+static int sync_destination(void) {
+    int result = 0;
+    TRACE_BEGIN("syncfs", "durability");
+    for (int i=0; i<destinations_count; ++i) {
+        STATS_ADD(syscalls, 1);
+        if (syncfs(destination_fds[i]) == -1) {
+            perror("Erreur lors de la synchronisation de la destination");
+            STATS_ADD(errors, 1);
+            result = -1;
+        }
+    }
+    TRACE_END("syncfs", "durability");
+    pending_files = 0;
+    pending_bytes = 0;
+    return result;
+}
+
+/*!
+ * @brief durability_file_written is called after a file was written, before its fd is closed
+ * In file mode the file is synced at once; in batch mode the filesystem is synced once
+ * DURABILITY_BATCH_FILES files or DURABILITY_BATCH_BYTES bytes were written since the last sync.
+ * @param fd is the fd of the written file
+ * @param bytes is the number of bytes written
+ * @return 0 in case of success, -1 else
+ */
+int durability_file_written(int fd, uint64_t bytes) {
+    switch (durability_mode) {
+        case DURABILITY_FILE: {
+            TRACE_BEGIN("fdatasync", "durability");
+            int result = fdatasync(fd);
+            TRACE_END("fdatasync", "durability");
+            STATS_ADD(syscalls, 1);
+            if (result == -1) {
+                perror("Erreur lors de la synchronisation du fichier");
+                STATS_ADD(errors, 1);
+            }
+            return result;
+        }
+        case DURABILITY_BATCH:
+            pending_files++;
+            pending_bytes += bytes;
+            if (pending_files >= DURABILITY_BATCH_FILES || pending_bytes >= DURABILITY_BATCH_BYTES) {
+                return sync_destination();
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+/*!
+ * @brief durability_finish makes the whole synchronization durable (directories and metadata included)
+ * @return 0 in case of success, -1 else
+ */
+int durability_finish(void) {
+    if (durability_mode == DURABILITY_NONE) {
+        return 0;
+    }
+    int result = sync_destination();
+    for (int i=0; i<destinations_count; ++i) {
+        close(destination_fds[i]);
+    }
+    destinations_count = 0;
+    durability_mode = DURABILITY_NONE;
+    return result;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+#include <configuration.h>
+
+// In batch mode, the destination filesystem is synced every time one of these amounts is written
+#define DURABILITY_BATCH_FILES 1000
+#define DURABILITY_BATCH_BYTES (256ULL * 1024 * 1024)
+
+int durability_init(durability_mode_t mode, char *destination);
+int durability_add_destination(char *destination);
+int durability_file_written(int fd, uint64_t bytes);
+int durability_finish(void);
@@ -0,0 +1,411 @@
+#include <extsort.h>
+#include <files-list.h>
+#include <stats.h>
+#include <trace.h>
+#include <filter.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char *arena; // Records of the current run: header, then path with its final zero
+    size_t arena_size;
+    size_t arena_used;
+    size_t *offsets; // Offset of each record of the current run in the arena
+    size_t offsets_capacity;
+    size_t count;
+    FILE **runs;
+    unsigned *levels; // Number of merges each run went through (non-increasing along the array)
+    size_t runs_count;
+    size_t runs_capacity;
+} extsort_builder_t;
+
+// qsort n'a pas de paramètre de contexte : arène du tri en cours
+static const char *sorted_arena = NULL;
+
+/*!
+ * @brief compare_arena_records compares two records of the sorted arena by relative path
+ */
+static int compare_arena_records(const void *lhd, const void *rhd) {
+    const char *left = sorted_arena + *(const size_t *)lhd + sizeof(extsort_record_header_t);
+    const char *right = sorted_arena + *(const size_t *)rhd + sizeof(extsort_record_header_t);
+    return strcmp(left, right);
+}
+
+/*!
+ * @brief extsort_write_entry writes an entry in a run or stream file
+ * @param output is the file to write into
+ * @param entry is the entry to write
+ * @return 0 in case of success, -1 else
+ */
+int extsort_write_entry(FILE *output, extsort_entry_t *entry) {
+    if (fwrite(&entry->header, sizeof(extsort_record_header_t), 1, output) != 1
+        || fwrite(entry->path, entry->header.path_length, 1, output) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief extsort_reader_next reads the next entry of a run or stream file
+ * @param reader is the reader, whose current entry is replaced
+ * @return 1 when an entry was read, 0 at the end of the file, -1 in case of error
+ */
+int extsort_reader_next(extsort_reader_t *reader) {
+    reader->valid = false;
+    size_t header_read = fread(&reader->current.header, 1, sizeof(extsort_record_header_t), reader->file);
+    if (header_read != sizeof(extsort_record_header_t)) {
+        // Fin du fichier entre deux entrées, sinon en-tête tronqué ou erreur de lecture
+        return header_read == 0 && !ferror(reader->file) ? 0 : -1;
+    }
+    uint16_t length = reader->current.header.path_length;
+    if (length >= PATH_SIZE || fread(reader->current.path, length, 1, reader->file) != 1) {
+        return -1;
+    }
+    reader->current.path[length] = '\0';
+    reader->valid = true;
+    return 1;
+}
+
+/*!
+ * @brief extsort_reader_open starts reading a run or stream file from its beginning
+ * @param reader is the reader to initialize
+ * @param file is the file to read
+ * @return 1 when the first entry was read, 0 for an empty file, -1 in case of error
+ */
+int extsort_reader_open(extsort_reader_t *reader, FILE *file) {
+    reader->file = file;
+    rewind(file);
+    return extsort_reader_next(reader);
+}
+
+/*!
+ * @brief merge_runs merges sorted runs into a single sorted file with a k-way merge (binary heap)
+ * @param runs is the array of runs to merge (they are closed by the function, even on error)
+ * @param count is the number of runs, at most EXTSORT_MAX_FANIN
+ * @return the merged file, NULL in case of error
+ */
+static FILE *merge_runs(FILE **runs, size_t count) {
+    FILE *output = tmpfile();
+    extsort_reader_t *readers = malloc(count * sizeof(extsort_reader_t));
+    size_t *heap = malloc(count * sizeof(size_t));
+    if (output == NULL || readers == NULL || heap == NULL) {
+        perror("Erreur lors de la fusion des fichiers temporaires");
+        if (output != NULL) {
+            fclose(output);
+        }
+        for (size_t i=0; i<count; ++i) {
+            fclose(runs[i]);
+        }
+        free(readers);
+        free(heap);
+        return NULL;
+    }
+
+    bool failed = false;
+    size_t heap_size = 0;
+    for (size_t i=0; i<count && !failed; ++i) {
+        int opened = extsort_reader_open(&readers[i], runs[i]);
+        failed = opened == -1;
+        if (opened == 1) {
+            // Insertion dans le tas (remontée)
+            size_t position = heap_size++;
+            while (position > 0 && strcmp(readers[heap[(position - 1) / 2]].current.path, readers[i].current.path) > 0) {
+                heap[position] = heap[(position - 1) / 2];
+                position = (position - 1) / 2;
+            }
+            heap[position] = i;
+        }
+    }
+
+    while (heap_size > 0 && !failed) {
+        extsort_reader_t *smallest = &readers[heap[0]];
+        failed = extsort_write_entry(output, &smallest->current) == -1;
+        int next = extsort_reader_next(smallest);
+        failed = failed || next == -1;
+        if (next != 1) {
+            heap[0] = heap[--heap_size];
+        }
+        // Redescente de la racine
+        size_t position = 0;
+        while (true) {
+            size_t left = 2 * position + 1, right = left + 1, smallest_child = position;
+            if (left < heap_size && strcmp(readers[heap[left]].current.path, readers[heap[smallest_child]].current.path) < 0) {
+                smallest_child = left;
+            }
+            if (right < heap_size && strcmp(readers[heap[right]].current.path, readers[heap[smallest_child]].current.path) < 0) {
+                smallest_child = right;
+            }
+            if (smallest_child == position) {
+                break;
+            }
+            size_t swap = heap[position];
+            heap[position] = heap[smallest_child];
+            heap[smallest_child] = swap;
+            position = smallest_child;
+        }
+    }
+
+    for (size_t i=0; i<count; ++i) {
+        fclose(runs[i]);
+    }
+    free(readers);
+    free(heap);
+    if (failed) {
+        fclose(output);
+        return NULL;
+    }
+    return output;
+}
+
+/*!
+ * @brief merge_full_levels merges the last EXTSORT_MAX_FANIN runs as soon as they are at the same level
+ * Runs are merged while the tree is listed, not only at the end, so that at most EXTSORT_MAX_FANIN - 1
+ * runs per level are kept open.
+ * @param builder is the builder whose runs are merged
+ * @return 0 in case of success, -1 else
+ */
+static int merge_full_levels(extsort_builder_t *builder) {
+    while (builder->runs_count >= EXTSORT_MAX_FANIN) {
+        size_t first = builder->runs_count - EXTSORT_MAX_FANIN;
+        unsigned level = builder->levels[first];
+        if (level != builder->levels[builder->runs_count - 1]) {
+            break;
+        }
+        FILE *merged = merge_runs(builder->runs + first, EXTSORT_MAX_FANIN);
+        builder->runs_count = first;
+        if (merged == NULL) {
+            return -1;
+        }
+        builder->levels[builder->runs_count] = level + 1;
+        builder->runs[builder->runs_count++] = merged;
+    }
+    return 0;
+}
+
+/*!
+ * @brief flush_run sorts the records of the arena and writes them into a new temporary run file
+ * @param builder is the builder whose run is flushed
+ * @return 0 in case of success, -1 else
+ */
+static int flush_run(extsort_builder_t *builder) {
+    if (builder->count == 0) {
+        return 0;
+    }
+    if (builder->runs_count == builder->runs_capacity) {
+        size_t capacity = builder->runs_capacity ? builder->runs_capacity * 2 : 16;
+        FILE **runs = realloc(builder->runs, capacity * sizeof(FILE *));
+        if (runs == NULL) {
+            return -1;
+        }
+        builder->runs = runs;
+        unsigned *levels = realloc(builder->levels, capacity * sizeof(unsigned));
+        if (levels == NULL) {
+            return -1;
+        }
+        builder->levels = levels;
+        builder->runs_capacity = capacity;
+    }
+
+    sorted_arena = builder->arena;
+    qsort(builder->offsets, builder->count, sizeof(size_t), compare_arena_records);
+
+    FILE *run = tmpfile();
+    if (run == NULL) {
+        perror("Erreur lors de la création d'un fichier temporaire");
+        return -1;
+    }
+    for (size_t i=0; i<builder->count; ++i) {
+        const extsort_record_header_t *header = (const extsort_record_header_t *)(builder->arena + builder->offsets[i]);
+        if (fwrite(header, sizeof(extsort_record_header_t) + header->path_length, 1, run) != 1) {
+            perror("Erreur lors de l'écriture d'un fichier temporaire");
+            fclose(run);
+            return -1;
+        }
+    }
+    builder->levels[builder->runs_count] = 0;
+    builder->runs[builder->runs_count++] = run;
+    builder->count = 0;
+    builder->arena_used = 0;
+    return merge_full_levels(builder);
+}
+
+/*!
+ * @brief add_record adds an entry to the current run, flushing the run first when the budget is reached
+ * @param builder is the builder
+ * @param header is the header of the entry
+ * @param relative_path is the relative path of the entry
+ * @return 0 in case of success, -1 else
+ */
+static int add_record(extsort_builder_t *builder, extsort_record_header_t *header, const char *relative_path) {
+    size_t record_size = sizeof(extsort_record_header_t) + header->path_length + 1;
+    // Alignement des en-têtes dans l'arène
+    record_size = (record_size + 7) & ~(size_t)7;
+    if (builder->arena_used + record_size > builder->arena_size || builder->count == builder->offsets_capacity) {
+        if (flush_run(builder) == -1) {
+            return -1;
+        }
+    }
+    char *record = builder->arena + builder->arena_used;
+    memcpy(record, header, sizeof(extsort_record_header_t));
+    memcpy(record + sizeof(extsort_record_header_t), relative_path, header->path_length + 1);
+    builder->offsets[builder->count++] = builder->arena_used;
+    builder->arena_used += record_size;
+    return 0;
+}
+
+/*!
+ * @brief list_directory lists a directory recursively into the builder
+ * @param builder is the builder
+ * @param root is the root of the tree
+ * @param relative_dir is the path of the directory relative to root ("" for the root itself)
+ * @return 0 in case of success, -1 else
+ */
+static int list_directory(extsort_builder_t *builder, char *root, const char *relative_dir) {
+    char directory_path[PATH_SIZE];
+    snprintf(directory_path, sizeof(directory_path), "%s%s%s", root, relative_dir[0] ? "/" : "", relative_dir);
+    TRACE_BEGIN("scan_dir", "list");
+    DIR *dir = opendir(directory_path);
+    STATS_ADD(syscalls, 1);
+    if (dir == NULL) {
+        perror("Erreur lors de l'ouverture du dossier");
+        STATS_ADD(errors, 1);
+        TRACE_END("scan_dir", "list");
+        return 0;
+    }
+
+    int result = 0;
+    struct dirent *entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        STATS_ADD(entries_listed, 1);
+        char relative_path[PATH_SIZE], file_path[PATH_SIZE];
+        int length = snprintf(relative_path, sizeof(relative_path), "%s%s%s", relative_dir, relative_dir[0] ? "/" : "", entry->d_name);
+        if (length >= PATH_SIZE || snprintf(file_path, sizeof(file_path), "%s/%s", root, relative_path) >= PATH_SIZE) {
+            continue;
+        }
+
+        // Filtres évalués avant le stat quand readdir donne le type
+        if (entry->d_type != DT_UNKNOWN && filter_excluded(relative_path, entry->d_type == DT_DIR)) {
+            continue;
+        }
+        struct stat info;
+        STATS_ADD(syscalls, 1);
+        if (stat(file_path, &info) == -1) {
+            STATS_ADD(errors, 1);
+            continue;
+        }
+        STATS_ADD(files_stated, 1);
+        if (!S_ISREG(info.st_mode) && !S_ISDIR(info.st_mode)) {
+            continue;
+        }
+        if (entry->d_type == DT_UNKNOWN && filter_excluded(relative_path, S_ISDIR(info.st_mode))) {
+            continue;
+        }
+
+        extsort_record_header_t header;
+        memset(&header, 0, sizeof(header));
+        header.size = S_ISREG(info.st_mode) ? (uint64_t)info.st_size : 0;
+        header.mtime_ns = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+        header.mode = info.st_mode;
+        header.device = info.st_dev;
+        header.inode = info.st_ino;
+        header.links_count = (uint32_t)info.st_nlink;
+        header.entry_type = S_ISDIR(info.st_mode) ? DOSSIER : FICHIER;
+        header.path_length = (uint16_t)length;
+        result = add_record(builder, &header, relative_path);
+
+        if (result == 0 && S_ISDIR(info.st_mode)) {
+            result = list_directory(builder, root, relative_path);
+        }
+    }
+    closedir(dir);
+    TRACE_END("scan_dir", "list");
+    return result;
+}
+
+/*!
+ * @brief extsort_list_tree lists a tree into a sorted stream file, using at most memory_limit bytes for sorting
+ * Entries are gathered into runs that fit the memory budget, each run is sorted and spilled to a temporary
+ * file. Runs are merged by EXTSORT_MAX_FANIN while listing (@see merge_full_levels), then the remaining
+ * ones are merged into a single file.
+ * @param root is the root of the tree to list
+ * @param memory_limit is the memory budget in bytes
+ * @return the sorted stream (a temporary file, deleted when closed), NULL in case of error
+ */
+FILE *extsort_list_tree(char *root, size_t memory_limit) {
+    extsort_builder_t builder;
+    memset(&builder, 0, sizeof(builder));
+    // 3/4 du budget pour les enregistrements, 1/4 pour leur index
+    builder.arena_size = memory_limit / 4 * 3;
+    builder.offsets_capacity = memory_limit / 4 / sizeof(size_t);
+    if (builder.arena_size < sizeof(extsort_record_header_t) + PATH_SIZE + 8 || builder.offsets_capacity == 0) {
+        fprintf(stderr, "Limite mémoire trop faible\n");
+        return NULL;
+    }
+    builder.arena = malloc(builder.arena_size);
+    builder.offsets = malloc(builder.offsets_capacity * sizeof(size_t));
+    if (builder.arena == NULL || builder.offsets == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        free(builder.arena);
+        free(builder.offsets);
+        return NULL;
+    }
+
+    uint64_t list_start = stats_begin();
+    int result = list_directory(&builder, root, "");
+    if (result == 0) {
+        result = flush_run(&builder);
+    }
+    free(builder.arena);
+    free(builder.offsets);
+
+    if (result == 0 && builder.runs_count == 0) {
+        // Arborescence vide : flux vide
+        builder.runs = malloc(sizeof(FILE *));
+        if (builder.runs != NULL && (builder.runs[0] = tmpfile()) != NULL) {
+            builder.runs_count = 1;
+        } else {
+            result = -1;
+        }
+    }
+
+    // Fusions successives jusqu'à ne plus avoir qu'un fichier
+    while (result == 0 && builder.runs_count > 1) {
+        size_t merged_count = 0;
+        for (size_t first=0; first<builder.runs_count; first+=EXTSORT_MAX_FANIN) {
+            size_t group = builder.runs_count - first < EXTSORT_MAX_FANIN ? builder.runs_count - first : EXTSORT_MAX_FANIN;
+            FILE *merged = merge_runs(builder.runs + first, group);
+            if (merged == NULL) {
+                // Les fichiers restants sont fermés ci-dessous
+                for (size_t i=first+group; i<builder.runs_count; ++i) {
+                    fclose(builder.runs[i]);
+                }
+                builder.runs_count = merged_count;
+                result = -1;
+                break;
+            }
+            builder.runs[merged_count++] = merged;
+        }
+        if (result == 0) {
+            builder.runs_count = merged_count;
+        }
+    }
+    stats_end(PHASE_LIST, list_start);
+
+    FILE *sorted = NULL;
+    if (result == 0) {
+        sorted = builder.runs[0];
+        rewind(sorted);
+    } else {
+        for (size_t i=0; i<builder.runs_count; ++i) {
+            fclose(builder.runs[i]);
+        }
+    }
+    free(builder.runs);
+    free(builder.levels);
+    return sorted;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <defines.h>
+
+// Runs merged at once: EXTSORT_MAX_FANIN runs of the same level are merged as soon as they exist,
+// so at most EXTSORT_MAX_FANIN - 1 temporary files per level are open (levels grow logarithmically)
+#define EXTSORT_MAX_FANIN 64
+
+typedef struct {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t device;
+    uint64_t inode;
+    uint32_t links_count;
+    uint32_t mode;
+    uint16_t path_length;
+    uint8_t entry_type;
+    uint8_t padding;
+} extsort_record_header_t;
+
+typedef struct {
+    extsort_record_header_t header;
+    char path[PATH_SIZE]; // Path relative to the listed root
+} extsort_entry_t;
+
+typedef struct {
+    FILE *file;
+    extsort_entry_t current;
+    bool valid;
+} extsort_reader_t;
+
+FILE *extsort_list_tree(char *root, size_t memory_limit);
+int extsort_reader_open(extsort_reader_t *reader, FILE *file);
+int extsort_reader_next(extsort_reader_t *reader);
+int extsort_write_entry(FILE *output, extsort_entry_t *entry);
@@ -1,15 +1,28 @@
+#define _GNU_SOURCE // O_DIRECT
 #include <file-properties.h>
 
 #include <sys/stat.h>
 #include <dirent.h>
 #include <openssl/evp.h>
+#include <openssl/md5.h>
 #include <unistd.h>
 #include <assert.h>
 #include <string.h>
 #include <defines.h>
 #include <fcntl.h>
+#include <errno.h>
 #include <stdio.h>
 #include <utility.h>
+#include <stats.h>
+#include <trace.h>
+#include <ratelimit.h>
+#include <cache.h>
+#include <tuning.h>
+#include <diskorder.h>
+#include <time.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 /*!
  * @brief get_file_stats gets all of the required information for a file (inc. directories)
@@ -27,6 +40,22 @@
  * @return -1 in case of error, 0 else
  */
 int get_file_stats(files_list_entry_t *entry) {
+    if (get_file_metadata(entry) == -1) {
+        return -1;
+    }
+    if (entry->entry_type == FICHIER && compute_file_md5(entry) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief get_file_metadata gets the information of a file like get_file_stats, except its MD5 sum
+ * Used in lazy MD5 mode, where only entries whose metadata match on both sides are hashed later.
+ * @param entry is the files list entry to fill
+ * @return -1 in case of error, 0 else
+ */
+int get_file_metadata(files_list_entry_t *entry) {
     struct stat info;
 
     if (entry == NULL) {
@@ -34,24 +63,33 @@ int get_file_stats(files_list_entry_t *entry) {
         return -1;
     }
     
-    if (stat(entry->path_and_name, &info) == -1) {
+    uint64_t stat_start = stats_begin();
+    TRACE_BEGIN("stat", "analyze");
+    int stat_result = stat(entry->path_and_name, &info);
+    TRACE_END("stat", "analyze");
+    stats_end(PHASE_STAT, stat_start);
+    STATS_ADD(syscalls, 1);
+    if (stat_result == -1) {
         printf("Erreur lors de la lecture des informations du fichier ou du dossier");
+        STATS_ADD(errors, 1);
         return -1;
     }
+    STATS_ADD(files_stated, 1);
+    entry->device = info.st_dev;
+    entry->inode = info.st_ino;
+    entry->links_count = info.st_nlink;
     if (S_ISREG(info.st_mode)) {
         entry->mode = info.st_mode;
         entry->mtime.tv_sec = info.st_mtim.tv_sec; // Attribution du temps de modification
         entry->mtime.tv_nsec = info.st_mtim.tv_nsec; // Attribution des nanosecondes
         entry->size = info.st_size;
         entry->entry_type = FICHIER;
-
-        if (compute_file_md5(entry) == -1) {
-            return -1;
-        }
         return 0;
         
     } else if (S_ISDIR(info.st_mode)) {
         entry->mode = info.st_mode;
+        entry->mtime.tv_sec = info.st_mtim.tv_sec;
+        entry->mtime.tv_nsec = info.st_mtim.tv_nsec;
         entry->entry_type = DOSSIER;
         return 0;
         
@@ -71,28 +109,361 @@ int compute_file_md5(files_list_entry_t *entry) {
     FILE *file;
     unsigned char buffer[MD5_DIGEST_LENGTH];
     size_t bytesRead;
-    unsigned char data[1024];
+    unsigned char data[SAMPLE_BLOCK_SIZE];
     MD5_CTX md5Context;
 
+    uint64_t hash_start = stats_begin();
+    TRACE_BEGIN("hash", "analyze");
     file = fopen(entry->path_and_name, "rb");
+    STATS_ADD(syscalls, 1);
     if (file == NULL || entry == NULL) {
         perror("Erreur");
+        STATS_ADD(errors, 1);
+        TRACE_END("hash", "analyze");
+        stats_end(PHASE_HASH, hash_start);
         return -1;
     } else {
 
         MD5_Init(&md5Context);
+        cache_advise_sequential(fileno(file));
     
+        off_t consumed = 0, dropped = 0;
         while ((bytesRead = fread(data, 1, sizeof(data), file)) != 0) {
+            RATELIMIT(bytesRead);
             MD5_Update(&md5Context, data, bytesRead);
+            STATS_ADD(bytes_hashed, bytesRead);
+            // Mode neutre pour le cache : les pages déjà hachées sont libérées par morceaux
+            consumed += bytesRead;
+            if (cache_neutral && consumed - dropped >= CACHE_CHUNK_SIZE) {
+                cache_drop_read(fileno(file), dropped, consumed - dropped);
+                dropped = consumed;
+            }
         }
     
         MD5_Final(buffer, &md5Context);
+        cache_drop_read(fileno(file), 0, 0);
     
         fclose(file);
         memcpy(entry->md5sum, buffer, MD5_DIGEST_LENGTH);
-    
+
+        STATS_ADD(files_hashed, 1);
+        TRACE_END("hash", "analyze");
+        stats_end(PHASE_HASH, hash_start);
+        return 0;
+    }
+}
+
+/*!
+ * @brief compute_file_sample_md5 computes an MD5 sum over a few fixed samples of a file
+ * The samples are the head, the tail and SAMPLE_INNER_BLOCKS evenly spaced blocks of SAMPLE_BLOCK_SIZE bytes.
+ * Two files with different sample sums are different; equal sample sums still require a full comparison.
+ * @param entry is the files list entry (its size must be known), the sample sum is stored into its md5sum field
+ * @return -1 in case of error, 0 else
+ */
+int compute_file_sample_md5(files_list_entry_t *entry) {
+    if (entry == NULL) {
+        return -1;
+    }
+
+    uint64_t hash_start = stats_begin();
+    TRACE_BEGIN("sample_hash", "analyze");
+    int fd = open(entry->path_and_name, O_RDONLY);
+    STATS_ADD(syscalls, 1);
+    if (fd == -1) {
+        perror("Erreur");
+        STATS_ADD(errors, 1);
+        TRACE_END("sample_hash", "analyze");
+        stats_end(PHASE_HASH, hash_start);
+        return -1;
+    }
+
+    unsigned char data[SAMPLE_BLOCK_SIZE];
+    MD5_CTX md5Context;
+    MD5_Init(&md5Context);
+    // La taille fait partie de l'empreinte : deux fichiers de tailles différentes diffèrent toujours
+    MD5_Update(&md5Context, &entry->size, sizeof(entry->size));
+
+    uint64_t last_block = entry->size > SAMPLE_BLOCK_SIZE ? entry->size - SAMPLE_BLOCK_SIZE : 0;
+    int result = 0;
+    for (int i=0; i<SAMPLE_INNER_BLOCKS + 2; ++i) {
+        // Bloc 0 : début, bloc SAMPLE_INNER_BLOCKS + 1 : fin, les autres régulièrement espacés entre les deux
+        off_t offset = (off_t)(last_block * i / (SAMPLE_INNER_BLOCKS + 1));
+        RATELIMIT(sizeof(data));
+        ssize_t bytes_read = pread(fd, data, sizeof(data), offset);
+        STATS_ADD(syscalls, 1);
+        if (bytes_read < 0) {
+            perror("Erreur de lecture de l'échantillon");
+            STATS_ADD(errors, 1);
+            result = -1;
+            break;
+        }
+        MD5_Update(&md5Context, data, bytes_read);
+        STATS_ADD(bytes_hashed, bytes_read);
+    }
+    MD5_Final(entry->md5sum, &md5Context);
+    cache_drop_read(fd, 0, 0);
+    close(fd);
+
+    TRACE_END("sample_hash", "analyze");
+    stats_end(PHASE_HASH, hash_start);
+    return result;
+}
+
+/*!
+ * @brief compute_file_direct_md5 computes a file's MD5 sum from the storage, bypassing the page cache
+ * Used to verify copies: the pages just written would otherwise be read back from memory. When O_DIRECT
+ * is not supported by the filesystem, the cached pages of the file are dropped before a normal read.
+ * @param entry is the files list entry, its MD5 sum is stored into its md5sum field
+ * @return -1 in case of error, 0 else
+ */
+int compute_file_direct_md5(files_list_entry_t *entry) {
+    if (entry == NULL) {
+        return -1;
+    }
+
+    uint64_t hash_start = stats_begin();
+    TRACE_BEGIN("direct_hash", "verify");
+    int fd = open(entry->path_and_name, O_RDONLY | O_DIRECT);
+    STATS_ADD(syscalls, 1);
+    if (fd == -1 && errno == EINVAL) {
+        fd = open(entry->path_and_name, O_RDONLY);
+        STATS_ADD(syscalls, 2);
+        if (fd != -1) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    }
+    void *data = NULL;
+    if (fd == -1 || posix_memalign(&data, DIRECT_READ_ALIGNMENT, DIRECT_READ_SIZE) != 0) {
+        perror("Erreur");
+        STATS_ADD(errors, 1);
+        if (fd != -1) {
+            close(fd);
+        }
+        TRACE_END("direct_hash", "verify");
+        stats_end(PHASE_HASH, hash_start);
+        return -1;
+    }
+
+    MD5_CTX md5Context;
+    MD5_Init(&md5Context);
+    int result = 0;
+    ssize_t bytes_read;
+    // Avec O_DIRECT, seule la dernière lecture peut être plus courte que le tampon
+    while ((bytes_read = read(fd, data, DIRECT_READ_SIZE)) > 0) {
+        STATS_ADD(syscalls, 1);
+        RATELIMIT(bytes_read);
+        MD5_Update(&md5Context, data, bytes_read);
+        STATS_ADD(bytes_hashed, bytes_read);
+    }
+    if (bytes_read == -1) {
+        perror("Erreur de lecture");
+        STATS_ADD(errors, 1);
+        result = -1;
+    }
+    MD5_Final(entry->md5sum, &md5Context);
+    free(data);
+    close(fd);
+
+    STATS_ADD(files_hashed, 1);
+    TRACE_END("direct_hash", "verify");
+    stats_end(PHASE_HASH, hash_start);
+    return result;
+}
+
+/*!
+ * @brief hash_file computes the sum of a file in one of the reading modes of compute_files_md5_parallel
+ */
+static int hash_file(files_list_entry_t *entry, hash_mode_t mode) {
+    switch (mode) {
+        case HASH_SAMPLED:
+            return compute_file_sample_md5(entry);
+        case HASH_DIRECT:
+            return compute_file_direct_md5(entry);
+        default:
+            return compute_file_md5(entry);
+    }
+}
+
+/*!
+ * @brief hash_files_sequentially computes the sums of several files in the calling process
+ * @return the number of files that could not be hashed
+ */
+static int hash_files_sequentially(files_list_entry_t **entries, size_t count, hash_mode_t mode) {
+    int failures = 0;
+    for (size_t i=0; i<count; ++i) {
+        if (hash_file(entries[i], mode) == -1) {
+            failures++;
+        }
+    }
+    return failures;
+}
+
+typedef struct {
+    size_t next_index; // Prochain fichier à hacher
+    uint32_t active_count; // Les processus d'indice inférieur prennent du travail, les autres attendent
+    uint64_t bytes_done; // Volume haché, pour mesurer le débit
+} hash_pool_t;
+
+/*!
+ * @brief tune_hash_pool waits for the workers of a pool, adapting the number of active ones to the throughput
+ * @param pool is the shared state of the pool
+ * @param pids is the array of the workers
+ * @param count is the number of workers
+ */
+static void tune_hash_pool(hash_pool_t *pool, pid_t *pids, int count) {
+    int remaining = count;
+    uint64_t sample_start = stats_now();
+    uint64_t sample_bytes = 0;
+    while (remaining > 0) {
+        struct timespec pause = {0, HASH_POOL_IDLE_NS};
+        nanosleep(&pause, NULL);
+        for (int w=0; w<count; ++w) {
+            if (pids[w] > 0 && waitpid(pids[w], NULL, WNOHANG) == pids[w]) {
+                pids[w] = 0;
+                remaining--;
+            }
+        }
+        uint64_t now = stats_now();
+        if (now - sample_start >= TUNING_SAMPLE_NS) {
+            uint64_t bytes = __atomic_load_n(&pool->bytes_done, __ATOMIC_RELAXED);
+            uint64_t rate = (bytes - sample_bytes) * 1000000000ULL / (now - sample_start);
+            __atomic_store_n(&pool->active_count, tuning_adjust(rate), __ATOMIC_RELAXED);
+            sample_start = now;
+            sample_bytes = bytes;
+        }
+    }
+}
+
+/*!
+ * @brief hash_files_pool computes the sums of several files with a pool of processes (@see compute_files_md5_parallel)
+ */
+static int hash_files_pool(files_list_entry_t **entries, size_t count, int workers_count, hash_mode_t mode) {
+    // -n auto : tous les processus possibles sont créés, seuls les premiers prennent du travail
+    uint32_t active_count = workers_count;
+    if (tuning_enabled) {
+        workers_count = (int)tuning_maximum_workers();
+        active_count = tuning_active_workers();
+    }
+
+    if (workers_count <= 1 || count == 1) {
+        return hash_files_sequentially(entries, count, mode);
+    }
+
+    // Zone partagée : état du groupe, puis pour chaque fichier son empreinte et son statut
+    size_t shared_size = sizeof(hash_pool_t) + count * (MD5_DIGEST_LENGTH + 1);
+    uint8_t *shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("Erreur lors de l'allocation de la zone de hachage");
+        return -1;
+    }
+    hash_pool_t *pool = (hash_pool_t *)shared;
+    uint8_t *digests = shared + sizeof(hash_pool_t);
+    uint8_t *statuses = digests + count * MD5_DIGEST_LENGTH;
+    pool->next_index = 0;
+    pool->active_count = active_count;
+    pool->bytes_done = 0;
+
+    if ((size_t)workers_count > count) {
+        workers_count = (int)count;
+    }
+    pid_t *pids = malloc(workers_count * sizeof(pid_t));
+    if (pids == NULL) {
+        munmap(shared, shared_size);
+        return hash_files_sequentially(entries, count, mode);
+    }
+    fflush(stdout);
+    // Les emplacements de statistiques des processus de hachage servent à tous les groupes successifs
+    uint32_t stats_mark = stats_slots_mark();
+    int started = 0;
+    for (int w=0; w<workers_count; ++w) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("Erreur de création du processus de hachage");
+            break;
+        }
+        if (pid == 0) {
+            stats_attach_worker("hasher");
+            trace_attach_process("hasher");
+            while (__atomic_load_n(&pool->next_index, __ATOMIC_RELAXED) < count) {
+                // Processus en réserve : il attend que le réglage automatique l'active
+                if ((uint32_t)w >= __atomic_load_n(&pool->active_count, __ATOMIC_RELAXED)) {
+                    struct timespec pause = {0, HASH_POOL_IDLE_NS};
+                    nanosleep(&pause, NULL);
+                    continue;
+                }
+                size_t i = __atomic_fetch_add(&pool->next_index, 1, __ATOMIC_RELAXED);
+                if (i >= count) {
+                    break;
+                }
+                files_list_entry_t work = *entries[i];
+                uint64_t hashed_before = my_stats->bytes_hashed;
+                int result = hash_file(&work, mode);
+                statuses[i] = result == 0 ? 1 : 0;
+                memcpy(digests + i * MD5_DIGEST_LENGTH, work.md5sum, MD5_DIGEST_LENGTH);
+                __atomic_fetch_add(&pool->bytes_done, my_stats->bytes_hashed - hashed_before, __ATOMIC_RELAXED);
+            }
+            trace_flush();
+            exit(EXIT_SUCCESS);
+        }
+        pids[started++] = pid;
+    }
+    if (tuning_enabled) {
+        tune_hash_pool(pool, pids, started);
+    } else {
+        for (int w=0; w<started; ++w) {
+            wait(NULL);
+        }
+    }
+    free(pids);
+    stats_slots_release(stats_mark);
+
+    // Aucun processus n'a pu être créé : hachage dans le processus courant
+    if (started == 0) {
+        munmap(shared, shared_size);
+        return hash_files_sequentially(entries, count, mode);
+    }
+
+    int failures = 0;
+    for (size_t i=0; i<count; ++i) {
+        if (statuses[i]) {
+            memcpy(entries[i]->md5sum, digests + i * MD5_DIGEST_LENGTH, MD5_DIGEST_LENGTH);
+        } else {
+            failures++;
+        }
+    }
+    munmap(shared, shared_size);
+    return failures;
+}
+
+/*!
+ * @brief compute_files_md5_parallel computes the MD5 sums of several files with a pool of processes
+ * Workers take the next file to hash from a shared counter, so big and small files balance by themselves.
+ * With --disk-order, files are handed out in the order of their data on the disk.
+ * Digests are written by the workers into a shared array, then copied into the entries by the caller.
+ * @param entries is an array of pointers to the entries to hash
+ * @param count is the number of entries
+ * @param workers_count is the number of processes to use (1 hashes in the calling process)
+ * @param mode selects full sums, sample sums (@see compute_file_sample_md5) or full sums read from the
+ * storage (@see compute_file_direct_md5)
+ * @return the number of files that could not be hashed, -1 if the pool could not be created
+ */
+int compute_files_md5_parallel(files_list_entry_t **entries, size_t count, int workers_count, hash_mode_t mode) {
+    if (entries == NULL || count == 0) {
         return 0;
     }
+    if (!diskorder_enabled) {
+        return hash_files_pool(entries, count, workers_count, mode);
+    }
+    // Copie du tableau : l'ordre des entrées de l'appelant est conservé
+    files_list_entry_t **ordered = malloc(count * sizeof(files_list_entry_t *));
+    if (ordered == NULL) {
+        return hash_files_pool(entries, count, workers_count, mode);
+    }
+    memcpy(ordered, entries, count * sizeof(files_list_entry_t *));
+    diskorder_sort(ordered, count);
+    int failures = hash_files_pool(ordered, count, workers_count, mode);
+    free(ordered);
+    return failures;
 }
 
 /*!
@@ -100,7 +471,7 @@ int compute_file_md5(files_list_entry_t *entry) {
  * @path_to_dir a string with the path to the directory
  * @return true if directory exists, false else
  */
-bool directory_exists(char *path_to_dir) {
+bool directory_exists(const char *path_to_dir) {
 
     if (path_to_dir == NULL) {
         printf("Erreur répertoire : NULL\n");
@@ -4,7 +4,23 @@
 #include <stdbool.h>
 #include <configuration.h>
 
+#define SAMPLE_BLOCK_SIZE 65536
+#define SAMPLE_INNER_BLOCKS 8
+// Under this size, sampling would read most of the file: the full sum is computed directly
+#define SAMPLE_MIN_SIZE (16 * SAMPLE_BLOCK_SIZE)
+// Reads that bypass the page cache (O_DIRECT) use aligned buffers of this size
+#define DIRECT_READ_SIZE (1024 * 1024)
+#define DIRECT_READ_ALIGNMENT 4096
+// Pause of the idle workers of a hashing pool, and period at which the pool is watched with -n auto
+#define HASH_POOL_IDLE_NS 10000000L
+
+typedef enum { HASH_FULL, HASH_SAMPLED, HASH_DIRECT } hash_mode_t;
+
 int get_file_stats(files_list_entry_t *entry);
+int get_file_metadata(files_list_entry_t *entry);
 int compute_file_md5(files_list_entry_t *entry);
-bool directory_exists(char *path_to_dir);
+int compute_file_sample_md5(files_list_entry_t *entry);
+int compute_file_direct_md5(files_list_entry_t *entry);
+int compute_files_md5_parallel(files_list_entry_t **entries, size_t count, int workers_count, hash_mode_t mode);
+bool directory_exists(const char *path_to_dir);
 bool is_directory_writable(char *path_to_dir);
\ No newline at end of file
@@ -4,6 +4,8 @@
 #include <string.h>
 
 #include <stdio.h>
+#include <stats.h>
+#include <trace.h>
 
 /*!
  * @brief clear_files_list clears a files list
@@ -43,18 +45,29 @@ files_list_entry_t *add_file_entry(files_list_t *list, char *file_path) {
 
     // Remplir les propriétés de la nouvelle entrée en utilisant stat sur le fichier
     struct stat file_stat;
-    if (stat(file_path, &file_stat) != 0) {
+    uint64_t stat_start = stats_begin();
+    TRACE_BEGIN("stat", "list");
+    int stat_result = stat(file_path, &file_stat);
+    TRACE_END("stat", "list");
+    stats_end(PHASE_STAT, stat_start);
+    STATS_ADD(syscalls, 1);
+    if (stat_result != 0) {
         free(new_entry);
+        STATS_ADD(errors, 1);
         return NULL;  // Échec de l'obtention des informations sur le fichier
     }
+    STATS_ADD(files_stated, 1);
 
     strncpy(new_entry->path_and_name, file_path, sizeof(new_entry->path_and_name));
     new_entry->path_and_name[sizeof(new_entry->path_and_name) - 1] = '\0';
     new_entry->mtime.tv_sec = file_stat.st_mtime;
-    new_entry->mtime.tv_nsec = 0;
+    new_entry->mtime.tv_nsec = file_stat.st_mtim.tv_nsec;
     new_entry->size = file_stat.st_size;
     new_entry->entry_type = S_ISDIR(file_stat.st_mode) ? DOSSIER : FICHIER;
     new_entry->mode = file_stat.st_mode;
+    new_entry->device = file_stat.st_dev;
+    new_entry->inode = file_stat.st_ino;
+    new_entry->links_count = file_stat.st_nlink;
     memset(new_entry->md5sum, 0, sizeof(new_entry->md5sum));  // Remplir le MD5 à votre discrétion
 
    files_list_entry_t *prev = NULL;
@@ -70,6 +83,12 @@ files_list_entry_t *add_file_entry(files_list_t *list, char *file_path) {
         // L'élément doit être inséré au début de la liste
         new_entry->next = list->head;
         new_entry->prev = NULL;
+        if (list->head != NULL) {
+            list->head->prev = new_entry;
+        } else {
+            // La liste était vide : l'élément en est aussi la queue (@see add_entry_to_tail)
+            list->tail = new_entry;
+        }
         list->head = new_entry;
     } else {
         // Insérer entre prev et cursor
@@ -137,7 +156,7 @@ files_list_entry_t *find_entry_by_name(files_list_t *list, char *file_path, size
     // Parcourir la liste pour trouver l'entrée correspondante
     for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
         // Comparer les noms des fichiers en ignorant les parties de chemin spécifiées
-        if (strcmp(cursor->path_and_name + start_of_src, file_path + start_of_dest) == 0) {
+        if (strcmp(cursor->path_and_name + start_of_dest, file_path + start_of_src) == 0) {
             return cursor;  // Entrée trouvée
         }
     }
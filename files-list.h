@@ -14,6 +14,9 @@ typedef struct _files_list_entry {
   uint8_t md5sum[16];
   file_type_t entry_type;
   mode_t mode;
+  dev_t device;
+  ino_t inode;
+  nlink_t links_count;
   struct _files_list_entry *next;
   struct _files_list_entry *prev;
 } files_list_entry_t;
@@ -0,0 +1,356 @@
+#include <filter.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef enum { OP_CHAR, OP_ANY, OP_STAR, OP_GLOBSTAR, OP_CLASS } glob_op_type_t;
+
+typedef struct {
+    glob_op_type_t type;
+    unsigned char c;
+    bool negated;
+    uint8_t set[32]; // Ensemble de caractères d'une classe [...] (bit par octet)
+} glob_op_t;
+
+typedef struct {
+    bool include;
+    bool directory_only;
+    bool match_path;    // Motif contenant un '/' : comparé au chemin relatif complet, sinon au nom seul
+    bool literal;       // Motif sans joker : recherché dans une table de hachage
+    char *text;
+    glob_op_t *ops;
+    size_t ops_count;
+    size_t next_same_key; // Règle littérale suivante de même texte (rules_count si aucune)
+} filter_rule_t;
+
+typedef struct {
+    const char *key;
+    bool match_path;
+    size_t first_rule;
+} literal_slot_t;
+
+static filter_rule_t *rules = NULL;
+static size_t rules_count = 0;
+static size_t rules_capacity = 0;
+static literal_slot_t *literals = NULL;
+static size_t literals_capacity = 0;
+static bool has_literals = false;
+
+/*!
+ * @brief filter_add_rule appends a rule; rules are evaluated in order and the first matching rule wins
+ * A pattern matches the name of an entry, or its path relative to the root when it contains a '/'
+ * (a leading '/' is ignored). A trailing '/' restricts the rule to directories. Wildcards are '*' (any
+ * characters but '/'), '**' (any characters), '?' and [...] classes.
+ * @param pattern is the glob pattern
+ * @param include is true for an include rule, false for an exclude rule
+ * @return 0 in case of success, -1 else
+ */
+int filter_add_rule(const char *pattern, bool include) {
+    if (pattern == NULL || pattern[0] == '\0') {
+        return -1;
+    }
+    if (rules_count == rules_capacity) {
+        size_t new_capacity = rules_capacity ? rules_capacity * 2 : 16;
+        filter_rule_t *new_rules = realloc(rules, new_capacity * sizeof(filter_rule_t));
+        if (new_rules == NULL) {
+            return -1;
+        }
+        rules = new_rules;
+        rules_capacity = new_capacity;
+    }
+    filter_rule_t *rule = &rules[rules_count];
+    memset(rule, 0, sizeof(filter_rule_t));
+    while (*pattern == '/') {
+        pattern++;
+    }
+    rule->text = strdup(pattern);
+    if (rule->text == NULL) {
+        return -1;
+    }
+    size_t length = strlen(rule->text);
+    while (length > 0 && rule->text[length - 1] == '/') {
+        rule->text[--length] = '\0';
+        rule->directory_only = true;
+    }
+    rule->include = include;
+    rule->match_path = strchr(rule->text, '/') != NULL;
+    rules_count++;
+    return 0;
+}
+
+/*!
+ * @brief filter_load_file reads rules from a file, one pattern per line
+ * Empty lines and lines starting with '#' are ignored; "+ pattern" is an include rule, "- pattern" or a
+ * bare pattern is an exclude rule.
+ * @param path is the path of the rules file
+ * @return 0 in case of success, -1 else
+ */
+int filter_load_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror("Erreur lors de l'ouverture du fichier de filtres");
+        return -1;
+    }
+    char line[4096];
+    int result = 0;
+    while (result == 0 && fgets(line, sizeof(line), file) != NULL) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0' || line[0] == '#') {
+            continue;
+        }
+        if ((line[0] == '+' || line[0] == '-') && line[1] == ' ') {
+            result = filter_add_rule(line + 2, line[0] == '+');
+        } else {
+            result = filter_add_rule(line, false);
+        }
+    }
+    fclose(file);
+    return result;
+}
+
+/*!
+ * @brief compile_glob translates a glob pattern into a sequence of matching operations
+ * @param rule is the rule whose text is compiled
+ * @return 0 in case of success, -1 else
+ */
+static int compile_glob(filter_rule_t *rule) {
+    rule->ops = calloc(strlen(rule->text) + 1, sizeof(glob_op_t));
+    if (rule->ops == NULL) {
+        return -1;
+    }
+    const unsigned char *p = (const unsigned char *)rule->text;
+    rule->literal = true;
+    while (*p) {
+        glob_op_t *op = &rule->ops[rule->ops_count++];
+        if (*p == '*' && p[1] == '*') {
+            op->type = OP_GLOBSTAR;
+            while (*p == '*') {
+                p++;
+            }
+            rule->literal = false;
+        } else if (*p == '*') {
+            op->type = OP_STAR;
+            p++;
+            rule->literal = false;
+        } else if (*p == '?') {
+            op->type = OP_ANY;
+            p++;
+            rule->literal = false;
+        } else if (*p == '[' && strchr((const char *)p + 1, ']') != NULL) {
+            op->type = OP_CLASS;
+            p++;
+            if (*p == '!' || *p == '^') {
+                op->negated = true;
+                p++;
+            }
+            // Un ']' en tête fait partie de la classe
+            bool first = true;
+            while (*p && (*p != ']' || first)) {
+                unsigned char low = *p, high = *p;
+                if (p[1] == '-' && p[2] && p[2] != ']') {
+                    high = p[2];
+                    p += 2;
+                }
+                for (unsigned int c = low; c <= high; ++c) {
+                    op->set[c / 8] |= 1 << (c % 8);
+                }
+                p++;
+                first = false;
+            }
+            if (*p == ']') {
+                p++;
+            }
+            rule->literal = false;
+        } else {
+            if (*p == '\\' && p[1]) {
+                p++;
+                rule->literal = false; // Le texte contient encore l'échappement
+            }
+            op->type = OP_CHAR;
+            op->c = *p++;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief hash_key is the FNV-1a hash of a string
+ */
+static size_t hash_key(const char *key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)key; *p; ++p) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+/*!
+ * @brief find_literal returns the slot of a literal key, or the free slot where to insert it
+ */
+static literal_slot_t *find_literal(const char *key, bool match_path) {
+    size_t index = hash_key(key) & (literals_capacity - 1);
+    while (literals[index].key != NULL
+        && (literals[index].match_path != match_path || strcmp(literals[index].key, key) != 0)) {
+        index = (index + 1) & (literals_capacity - 1);
+    }
+    return &literals[index];
+}
+
+/*!
+ * @brief filter_compile compiles the rules once, before the traversals
+ * Patterns without wildcards (the common case: node_modules, .cache...) go into a hash table, so that
+ * each entry costs one or two lookups whatever their number; only the glob patterns are matched one by one.
+ * @return 0 in case of success, -1 else
+ */
+int filter_compile(void) {
+    if (rules_count == 0) {
+        return 0;
+    }
+    literals_capacity = 16;
+    while (literals_capacity < 2 * rules_count) {
+        literals_capacity *= 2;
+    }
+    literals = calloc(literals_capacity, sizeof(literal_slot_t));
+    if (literals == NULL) {
+        return -1;
+    }
+    for (size_t i=0; i<rules_count; ++i) {
+        if (compile_glob(&rules[i]) == -1) {
+            return -1;
+        }
+        rules[i].next_same_key = rules_count;
+    }
+    // Parcours à rebours : chaque clé pointe sur la première règle, chaînée aux suivantes de même texte
+    for (size_t i=rules_count; i-- > 0; ) {
+        if (!rules[i].literal) {
+            continue;
+        }
+        literal_slot_t *slot = find_literal(rules[i].text, rules[i].match_path);
+        if (slot->key != NULL) {
+            rules[i].next_same_key = slot->first_rule;
+        }
+        slot->key = rules[i].text;
+        slot->match_path = rules[i].match_path;
+        slot->first_rule = i;
+        has_literals = true;
+    }
+    return 0;
+}
+
+/*!
+ * @brief match_ops matches a text against compiled glob operations
+ * @param ops is the array of operations
+ * @param count is the number of operations
+ * @param text is the text to match
+ * @return true if the whole text matches
+ */
+static bool match_ops(const glob_op_t *ops, size_t count, const unsigned char *text) {
+    for (size_t i=0; i<count; ++i) {
+        const glob_op_t *op = &ops[i];
+        switch (op->type) {
+            case OP_GLOBSTAR:
+            case OP_STAR:
+                // Essai de toutes les longueurs possibles, '*' s'arrête au premier '/'
+                for (const unsigned char *rest = text; ; ++rest) {
+                    if (match_ops(ops + i + 1, count - i - 1, rest)) {
+                        return true;
+                    }
+                    if (*rest == '\0' || (op->type == OP_STAR && *rest == '/')) {
+                        return false;
+                    }
+                }
+            case OP_ANY:
+                if (*text == '\0' || *text == '/') {
+                    return false;
+                }
+                break;
+            case OP_CLASS: {
+                bool in_set = (op->set[*text / 8] >> (*text % 8)) & 1;
+                if (*text == '\0' || *text == '/' || in_set == op->negated) {
+                    return false;
+                }
+                break;
+            }
+            case OP_CHAR:
+                if (*text != op->c) {
+                    return false;
+                }
+                break;
+        }
+        text++;
+    }
+    return *text == '\0';
+}
+
+/*!
+ * @brief rule_applies tests if a rule applies to an entry
+ */
+static bool rule_applies(filter_rule_t *rule, const char *relative_path, const char *name, bool is_directory) {
+    if (rule->directory_only && !is_directory) {
+        return false;
+    }
+    return match_ops(rule->ops, rule->ops_count, (const unsigned char *)(rule->match_path ? relative_path : name));
+}
+
+/*!
+ * @brief first_literal_rule returns the first applicable literal rule for a key
+ * @return the index of the rule, rules_count if none
+ */
+static size_t first_literal_rule(const char *key, bool match_path, bool is_directory) {
+    literal_slot_t *slot = find_literal(key, match_path);
+    if (slot->key == NULL) {
+        return rules_count;
+    }
+    for (size_t i=slot->first_rule; i<rules_count; i=rules[i].next_same_key) {
+        if (!rules[i].directory_only || is_directory) {
+            return i;
+        }
+    }
+    return rules_count;
+}
+
+/*!
+ * @brief filter_excluded tests if an entry is excluded (an excluded directory must not be opened)
+ * @param relative_path is the path of the entry relative to the root of the tree
+ * @param is_directory is true if the entry is a directory
+ * @return true if the first matching rule is an exclude rule, false else (no rule matching included)
+ */
+bool filter_excluded(const char *relative_path, bool is_directory) {
+    if (rules_count == 0 || literals == NULL) {
+        return false;
+    }
+    const char *name = strrchr(relative_path, '/');
+    name = name != NULL ? name + 1 : relative_path;
+
+    size_t first = rules_count;
+    if (has_literals) {
+        first = first_literal_rule(name, false, is_directory);
+        size_t by_path = first_literal_rule(relative_path, true, is_directory);
+        first = by_path < first ? by_path : first;
+    }
+    // Seuls les motifs à jokers placés avant la première règle littérale applicable sont évalués
+    for (size_t i=0; i<first; ++i) {
+        if (!rules[i].literal && rule_applies(&rules[i], relative_path, name, is_directory)) {
+            first = i;
+            break;
+        }
+    }
+    return first < rules_count && !rules[first].include;
+}
+
+/*!
+ * @brief filter_clear frees the rules
+ */
+void filter_clear(void) {
+    for (size_t i=0; i<rules_count; ++i) {
+        free(rules[i].text);
+        free(rules[i].ops);
+    }
+    free(rules);
+    free(literals);
+    rules = NULL;
+    literals = NULL;
+    rules_count = rules_capacity = literals_capacity = 0;
+    has_literals = false;
+}
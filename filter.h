@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+
+int filter_add_rule(const char *pattern, bool include);
+int filter_load_file(const char *path);
+int filter_compile(void);
+bool filter_excluded(const char *relative_path, bool is_directory);
+void filter_clear(void);
@@ -0,0 +1,108 @@
+#include <hardlinks.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef struct {
+    dev_t device;
+    ino_t inode;
+    char *destination_path; // NULL for a free slot
+} inode_slot_t;
+
+// Table à adressage ouvert : (périphérique, inode) de la source -> premier chemin écrit dans la destination
+static inode_slot_t *slots = NULL;
+static size_t slots_capacity = 0;
+static size_t slots_used = 0;
+
+/*!
+ * @brief inode_hash mixes the device and inode numbers
+ */
+static size_t inode_hash(dev_t device, ino_t inode) {
+    uint64_t key = (uint64_t)inode * 0x9E3779B97F4A7C15ULL ^ (uint64_t)device;
+    key ^= key >> 29;
+    return (size_t)key;
+}
+
+/*!
+ * @brief find_slot returns the slot of a key, or the free slot where to insert it
+ */
+static inode_slot_t *find_slot(dev_t device, ino_t inode) {
+    size_t index = inode_hash(device, inode) & (slots_capacity - 1);
+    while (slots[index].destination_path != NULL && (slots[index].device != device || slots[index].inode != inode)) {
+        index = (index + 1) & (slots_capacity - 1);
+    }
+    return &slots[index];
+}
+
+/*!
+ * @brief hardlinks_find looks up for a source file already written (or found identical) in the destination
+ * @param entry is the source entry, only files with several links are tracked
+ * @return the path of another link of the same source inode, relative to the destination root, NULL if none
+ */
+const char *hardlinks_find(files_list_entry_t *entry) {
+    if (entry == NULL || entry->links_count < 2 || slots_used == 0) {
+        return NULL;
+    }
+    return find_slot(entry->device, entry->inode)->destination_path;
+}
+
+/*!
+ * @brief hardlinks_remember records the destination path of a source file with several links
+ * Entries with a single link are ignored, so the map only grows with hard-linked files. Paths are relative
+ * to the destination root, so that the same map serves every destination of a fan-out.
+ * @param entry is the source entry
+ * @param destination_path is the path of its copy, relative to the destination root
+ * @return 0 in case of success (or nothing to do), -1 else
+ */
+int hardlinks_remember(files_list_entry_t *entry, const char *destination_path) {
+    if (entry == NULL || destination_path == NULL || entry->links_count < 2 || entry->entry_type != FICHIER) {
+        return 0;
+    }
+
+    // Agrandissement à 50 % de remplissage
+    if (2 * (slots_used + 1) > slots_capacity) {
+        size_t old_capacity = slots_capacity;
+        inode_slot_t *old_slots = slots;
+        slots_capacity = old_capacity ? old_capacity * 2 : 256;
+        slots = calloc(slots_capacity, sizeof(inode_slot_t));
+        if (slots == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            slots = old_slots;
+            slots_capacity = old_capacity;
+            return -1;
+        }
+        for (size_t i=0; i<old_capacity; ++i) {
+            if (old_slots[i].destination_path != NULL) {
+                *find_slot(old_slots[i].device, old_slots[i].inode) = old_slots[i];
+            }
+        }
+        free(old_slots);
+    }
+
+    inode_slot_t *slot = find_slot(entry->device, entry->inode);
+    if (slot->destination_path != NULL) {
+        return 0;
+    }
+    slot->destination_path = strdup(destination_path);
+    if (slot->destination_path == NULL) {
+        return -1;
+    }
+    slot->device = entry->device;
+    slot->inode = entry->inode;
+    slots_used++;
+    return 0;
+}
+
+/*!
+ * @brief hardlinks_clear frees the inode map
+ */
+void hardlinks_clear(void) {
+    for (size_t i=0; i<slots_capacity; ++i) {
+        free(slots[i].destination_path);
+    }
+    free(slots);
+    slots = NULL;
+    slots_capacity = 0;
+    slots_used = 0;
+}
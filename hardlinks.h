@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <files-list.h>
+
+const char *hardlinks_find(files_list_entry_t *entry);
+int hardlinks_remember(files_list_entry_t *entry, const char *destination_path);
+void hardlinks_clear(void);
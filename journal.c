@@ -0,0 +1,308 @@
+#include <journal.h>
+#include <stats.h>
+#include <trace.h>
+#include <utility.h>
+#include <defines.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+typedef struct {
+    char *path; // Chemin relatif à la racine
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t offset;
+    bool done;
+} journal_slot_t;
+
+bool journal_enabled = false;
+static int journal_fd = -1;
+static char journal_path[PATH_SIZE];
+static size_t start_of_src = 0;
+// Table à adressage ouvert : chemin relatif -> dernier état journalisé
+static journal_slot_t *slots = NULL;
+static size_t slots_capacity = 0;
+static size_t slots_used = 0;
+// Fichier en cours de copie
+static files_list_entry_t *current_entry = NULL;
+static off_t last_checkpoint = 0;
+
+/*!
+ * @brief path_hash is the FNV-1a hash of a path
+ */
+static size_t path_hash(const char *path) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; ++p) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+/*!
+ * @brief find_slot returns the slot of a path, or the free slot where to insert it
+ */
+static journal_slot_t *find_slot(const char *path) {
+    size_t index = path_hash(path) & (slots_capacity - 1);
+    while (slots[index].path != NULL && strcmp(slots[index].path, path) != 0) {
+        index = (index + 1) & (slots_capacity - 1);
+    }
+    return &slots[index];
+}
+
+/*!
+ * @brief update_slot records the state of a path in the table (the latest state wins)
+ * @return 0 in case of success, -1 else
+ */
+static int update_slot(const char *path, journal_record_header_t *header) {
+    // Agrandissement à 50 % de remplissage
+    if (2 * (slots_used + 1) > slots_capacity) {
+        size_t old_capacity = slots_capacity;
+        journal_slot_t *old_slots = slots;
+        slots_capacity = old_capacity ? old_capacity * 2 : 1024;
+        slots = calloc(slots_capacity, sizeof(journal_slot_t));
+        if (slots == NULL) {
+            slots = old_slots;
+            slots_capacity = old_capacity;
+            return -1;
+        }
+        for (size_t i=0; i<old_capacity; ++i) {
+            if (old_slots[i].path != NULL) {
+                *find_slot(old_slots[i].path) = old_slots[i];
+            }
+        }
+        free(old_slots);
+    }
+    journal_slot_t *slot = find_slot(path);
+    if (slot->path == NULL) {
+        slot->path = strdup(path);
+        if (slot->path == NULL) {
+            return -1;
+        }
+        slots_used++;
+    }
+    slot->size = header->size;
+    slot->mtime_ns = header->mtime_ns;
+    slot->offset = header->offset;
+    slot->done = header->type == JOURNAL_DONE;
+    return 0;
+}
+
+/*!
+ * @brief load_journal reads the records left by an interrupted run
+ * A record cut by the interruption ends the reading: the records before it are kept.
+ * @return 0 in case of success, -1 else
+ */
+static int load_journal(void) {
+    FILE *file = fopen(journal_path, "rb");
+    if (file == NULL) {
+        return 0; // Pas de journal : exécution complète précédente, ou première exécution
+    }
+    journal_record_header_t header;
+    char path[PATH_SIZE];
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.magic != JOURNAL_RECORD_MAGIC || header.path_length >= PATH_SIZE
+            || fread(path, 1, header.path_length, file) != header.path_length) {
+            break;
+        }
+        path[header.path_length] = '\0';
+        if (update_slot(path, &header) == -1) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    printf("Reprise d'une synchronisation interrompue : %zu entrées journalisées\n", slots_used);
+    return 0;
+}
+
+/*!
+ * @brief journal_open loads the journal of the destination and opens it to record the progress of this run
+ * @param the_config is a pointer to the configuration
+ * @return 0 in case of success, -1 else
+ */
+int journal_open(configuration_t *the_config) {
+    if (concat_path(journal_path, the_config->destination, JOURNAL_FILE_NAME) == NULL) {
+        return -1;
+    }
+    start_of_src = strlen(the_config->source) + 1;
+    if (load_journal() == -1) {
+        printf("Erreur lors de la lecture du journal\n");
+        journal_close(false);
+        return -1;
+    }
+    journal_fd = open(journal_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    STATS_ADD(syscalls, 1);
+    if (journal_fd == -1) {
+        perror("Erreur lors de l'ouverture du journal");
+        journal_close(false);
+        return -1;
+    }
+    journal_enabled = true;
+    return 0;
+}
+
+/*!
+ * @brief lookup returns the journaled state of a source entry, if the source did not change since
+ * @return the slot, NULL if the entry is not journaled or changed
+ */
+static journal_slot_t *lookup(files_list_entry_t *source_entry) {
+    if (slots_used == 0 || source_entry == NULL || strlen(source_entry->path_and_name) < start_of_src) {
+        return NULL;
+    }
+    journal_slot_t *slot = find_slot(source_entry->path_and_name + start_of_src);
+    int64_t mtime_ns = (int64_t)source_entry->mtime.tv_sec * 1000000000LL + source_entry->mtime.tv_nsec;
+    if (slot->path == NULL || slot->size != source_entry->size || slot->mtime_ns != mtime_ns) {
+        return NULL;
+    }
+    return slot;
+}
+
+/*!
+ * @brief journal_is_done tests if an entry was fully copied by an interrupted run (its source is unchanged)
+ * @param source_entry is the source entry
+ * @return true if the copy was completed, false else
+ */
+bool journal_is_done(files_list_entry_t *source_entry) {
+    journal_slot_t *slot = lookup(source_entry);
+    return slot != NULL && slot->done;
+}
+
+/*!
+ * @brief journal_resume_offset returns the offset up to which a file was durably copied by an interrupted run
+ * @param source_entry is the source entry
+ * @return the offset to resume the copy from, 0 to copy the whole file
+ */
+off_t journal_resume_offset(files_list_entry_t *source_entry) {
+    journal_slot_t *slot = lookup(source_entry);
+    if (slot == NULL || slot->done || slot->offset > source_entry->size) {
+        return 0;
+    }
+    return (off_t)slot->offset;
+}
+
+/*!
+ * @brief append_record appends a record to the journal, with a single write
+ * @return 0 in case of success, -1 else
+ */
+static int append_record(journal_record_type_t type, files_list_entry_t *source_entry, off_t offset) {
+    const char *path = source_entry->path_and_name + start_of_src;
+    char buffer[sizeof(journal_record_header_t) + PATH_SIZE];
+    journal_record_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = JOURNAL_RECORD_MAGIC;
+    header.type = type;
+    header.path_length = (uint16_t)strlen(path);
+    header.size = source_entry->size;
+    header.mtime_ns = (int64_t)source_entry->mtime.tv_sec * 1000000000LL + source_entry->mtime.tv_nsec;
+    header.offset = (uint64_t)offset;
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), path, header.path_length);
+
+    size_t length = sizeof(header) + header.path_length;
+    STATS_ADD(syscalls, 1);
+    if (write(journal_fd, buffer, length) != (ssize_t)length) {
+        perror("Erreur lors de l'écriture du journal");
+        STATS_ADD(errors, 1);
+        return -1;
+    }
+    return update_slot(path, &header);
+}
+
+/*!
+ * @brief journal_begin_file starts the journaling of the copy of a file
+ * @param source_entry is the source entry being copied
+ * @param start_offset is the offset the copy starts from (resumed copy)
+ */
+void journal_begin_file(files_list_entry_t *source_entry, off_t start_offset) {
+    if (!journal_enabled) {
+        return;
+    }
+    current_entry = source_entry;
+    last_checkpoint = start_offset;
+}
+
+/*!
+ * @brief journal_copied reports the progress of the current copy, and checkpoints it if needed
+ * The data is synced before its offset is journaled, so that a journaled offset is always durable.
+ * @param dest_fd is the destination file descriptor
+ * @param offset is the offset up to which the file is copied
+ */
+void journal_copied(int dest_fd, off_t offset) {
+    if (current_entry == NULL || offset - last_checkpoint < (off_t)JOURNAL_CHECKPOINT_BYTES) {
+        return;
+    }
+    TRACE_BEGIN("checkpoint", "journal");
+    STATS_ADD(syscalls, 1);
+    if (fdatasync(dest_fd) == 0) {
+        append_record(JOURNAL_PARTIAL, current_entry, offset);
+    }
+    last_checkpoint = offset;
+    TRACE_END("checkpoint", "journal");
+}
+
+/*!
+ * @brief journal_end_file ends the journaling of the current copy
+ * As for the checkpoints, the data is synced before the copy is journaled as done: a done copy is never
+ * compared again (@see journal_is_done).
+ * @param dest_fd is the destination file descriptor
+ * @param success is true if the file was completely copied
+ */
+void journal_end_file(int dest_fd, bool success) {
+    if (current_entry != NULL && success) {
+        TRACE_BEGIN("checkpoint", "journal");
+        STATS_ADD(syscalls, 1);
+        if (fdatasync(dest_fd) == 0) {
+            append_record(JOURNAL_DONE, current_entry, (off_t)current_entry->size);
+        }
+        TRACE_END("checkpoint", "journal");
+    }
+    current_entry = NULL;
+}
+
+/*!
+ * @brief journal_record_done records an entry completed without a data copy (hard link, rename)
+ * @param source_entry is the source entry
+ * @return 0 in case of success, -1 else
+ */
+int journal_record_done(files_list_entry_t *source_entry) {
+    if (!journal_enabled || source_entry == NULL) {
+        return 0;
+    }
+    return append_record(JOURNAL_DONE, source_entry, (off_t)source_entry->size);
+}
+
+/*!
+ * @brief journal_close closes the journal; it is removed once the synchronization is complete
+ * @param completed is true if every difference was synchronized
+ */
+void journal_close(bool completed) {
+    if (journal_fd != -1) {
+        close(journal_fd);
+        journal_fd = -1;
+        if (completed) {
+            unlink(journal_path);
+        }
+    }
+    for (size_t i=0; i<slots_capacity; ++i) {
+        free(slots[i].path);
+    }
+    free(slots);
+    slots = NULL;
+    slots_capacity = slots_used = 0;
+    current_entry = NULL;
+    journal_enabled = false;
+}
+
+/*!
+ * @brief is_journal_entry tests if an entry is the journal file itself (it must never be synchronized)
+ * @param entry is the entry to test
+ * @param root is the root of the tree of the entry
+ * @return true if the entry is the journal, false else
+ */
+bool is_journal_entry(files_list_entry_t *entry, char *root) {
+    size_t root_length = strlen(root);
+    return strncmp(entry->path_and_name, root, root_length) == 0
+        && strcmp(entry->path_and_name + root_length + 1, JOURNAL_FILE_NAME) == 0;
+}
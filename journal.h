@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <files-list.h>
+#include <configuration.h>
+
+#define JOURNAL_FILE_NAME ".lp25-journal"
+#define JOURNAL_RECORD_MAGIC 0x4c50324aU // "LP2J"
+// A partially copied file is checkpointed (data synced, then offset journaled) every time this amount is copied
+#define JOURNAL_CHECKPOINT_BYTES (64ULL * 1024 * 1024)
+
+typedef enum { JOURNAL_DONE = 1, JOURNAL_PARTIAL = 2 } journal_record_type_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t padding;
+    uint16_t path_length;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint64_t offset;
+} journal_record_header_t;
+
+extern bool journal_enabled;
+
+#define JOURNAL_COPIED(fd, offset) do { if (journal_enabled) journal_copied(fd, offset); } while (0)
+
+int journal_open(configuration_t *the_config);
+bool journal_is_done(files_list_entry_t *source_entry);
+off_t journal_resume_offset(files_list_entry_t *source_entry);
+void journal_begin_file(files_list_entry_t *source_entry, off_t start_offset);
+void journal_copied(int dest_fd, off_t offset);
+void journal_end_file(int dest_fd, bool success);
+int journal_record_done(files_list_entry_t *source_entry);
+void journal_close(bool completed);
+bool is_journal_entry(files_list_entry_t *entry, char *root);
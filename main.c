@@ -4,6 +4,16 @@
 #include <configuration.h>
 #include <file-properties.h>
 #include <processes.h>
+#include <stats.h>
+#include <progress.h>
+#include <trace.h>
+#include <ratelimit.h>
+#include <cache.h>
+#include <filter.h>
+#include <remote.h>
+#include <verify.h>
+#include <tuning.h>
+#include <diskorder.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <sys/stat.h>
@@ -29,40 +39,103 @@ int main(int argc, char *argv[]) {
     }
 
     // - destination exists and can be written OR doesn't exist but can be created
-    DIR *destination;
-    destination = opendir(my_config.destination);
-    if (destination == NULL) {
-        printf("Erreur lors de l'ouverture de la destination : %s\n", my_config.destination);
-        int mkdir_result = mkdir(my_config.destination, 0755);
-        if (mkdir_result == -1) {
-            perror("Erreur lors de la création de la destination");
+    // (a remote destination is checked by its receiver, a receiver has no source)
+    bool is_serving = my_config.serve_address[0] != '\0';
+    if (!remote_is_address(my_config.destination)) {
+        DIR *destination;
+        destination = opendir(my_config.destination);
+        if (destination == NULL) {
+            printf("Erreur lors de l'ouverture de la destination : %s\n", my_config.destination);
+            int mkdir_result = mkdir(my_config.destination, 0755);
+            if (mkdir_result == -1) {
+                perror("Erreur lors de la création de la destination");
+                return -1;
+            }
+            printf("Le repertoire : %s (destination), a été créé\n", my_config.destination);
+        }
+        closedir(destination);
+
+        // Check directories
+        if ((!is_serving && !directory_exists(my_config.source)) || !directory_exists(my_config.destination)) {
+            printf("Either source or destination directory do not exist\nAborting\n");
+            return -1;
+        }
+    
+        // Is destination writable?
+        if (!is_directory_writable(my_config.destination)) {
+            printf("Destination directory %s is not writable\n", my_config.destination);
+            return -1;
+        }
+    } else if (!directory_exists(my_config.source)) {
+        printf("Source directory %s does not exist\nAborting\n", my_config.source);
+        return -1;
+    }
+
+    // Same checks for the other destinations of a fan-out
+    for (int i = 0; i < my_config.extra_destinations_count; i++) {
+        char *extra = my_config.extra_destinations[i];
+        if (!directory_exists(extra)) {
+            if (mkdir(extra, 0755) == -1) {
+                perror("Erreur lors de la création de la destination");
+                return -1;
+            }
+            printf("Le repertoire : %s (destination), a été créé\n", extra);
+        }
+        if (!is_directory_writable(extra)) {
+            printf("Destination directory %s is not writable\n", extra);
             return -1;
         }
-        printf("Le repertoire : %s (destination), a été créé\n", my_config.destination);
     }
-    closedir(destination);
 
-    // Check directories
-    if (!directory_exists(my_config.source) || !directory_exists(my_config.destination)) {
-        printf("Either source or destination directory do not exist\nAborting\n");
+    // -n auto: bounds from the cores and the devices, once the destination exists
+    if (tuning_init(&my_config) == -1) {
         return -1;
     }
-    
-    // Is destination writable?
-    if (!is_directory_writable(my_config.destination)) {
-        printf("Destination directory %s is not writable\n", my_config.destination);
+
+    cache_set_neutral(my_config.cache_neutral);
+    diskorder_enable(my_config.disk_order);
+    if (filter_compile() == -1) {
+        printf("Erreur lors de la compilation des filtres\n");
+        return -1;
+    }
+
+    // Statistics block must exist before the fork so that children share it
+    bool needs_counters = my_config.show_stats || my_config.show_progress || my_config.progress_fd >= 0;
+    if (stats_init(needs_counters) == -1 || trace_init(my_config.trace_path) == -1
+        || ratelimit_init(my_config.bwlimit, my_config.iops_limit, my_config.io_idle) == -1 || progress_start(&my_config) == -1) {
         return -1;
     }
 
+    // Receiver: serves senders until it is stopped
+    if (is_serving) {
+        return remote_serve(my_config.serve_address, my_config.destination, &my_config);
+    }
+
     // Prepare (fork, MQ) if parallel
     process_context_t processes_context;
     prepare(&my_config, &processes_context);
 
     // Run synchronize:
     synchronize(&my_config, &processes_context);
+
+    // Read back the copies, once they are all written
+    int verify_failures = 0;
+    if (my_config.verify) {
+        verify_failures = verify_run(my_config.processes_count);
+        verify_clear();
+    }
     
     // Clean resources
     clean_processes(&my_config, &processes_context);
 
-    return 0;
+    // Report statistics of all processes
+    progress_stop();
+    trace_merge();
+    stats_report(my_config.show_stats ? my_config.stats_path : NULL);
+    stats_release();
+    ratelimit_release();
+    filter_clear();
+
+    // Corrupted or unreadable copies (or no verification at all) make the run fail
+    return verify_failures != 0 ? -1 : 0;
 }
@@ -0,0 +1,349 @@
+#include <manifest.h>
+#include <defines.h>
+#include <utility.h>
+#include <stats.h>
+#include <journal.h>
+#include <pack.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*!
+ * @brief manifest_open maps the manifest of a tree, previously written by manifest_write
+ * The manifest is validated (magic, version, bounds) before being used.
+ * @param manifest is the structure to fill
+ * @param root is the root of the tree (the manifest is stored in it)
+ * @return 0 in case of success, -1 if there is no valid manifest
+ */
+int manifest_open(manifest_t *manifest, char *root) {
+    if (manifest == NULL || root == NULL) {
+        return -1;
+    }
+    memset(manifest, 0, sizeof(manifest_t));
+
+    char manifest_path[PATH_SIZE];
+    if (concat_path(manifest_path, root, MANIFEST_FILE_NAME) == NULL) {
+        return -1;
+    }
+    int fd = open(manifest_path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(manifest_header_t)) {
+        close(fd);
+        return -1;
+    }
+    void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        perror("Erreur lors de la projection du manifeste");
+        return -1;
+    }
+
+    const manifest_header_t *header = mapping;
+    uint64_t records_end = sizeof(manifest_header_t) + (uint64_t)header->entries_count * sizeof(manifest_record_t);
+    if (memcmp(header->magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC)) != 0 || header->version != MANIFEST_VERSION
+        || records_end > header->strings_offset || header->strings_offset + header->strings_size != (uint64_t)info.st_size) {
+        fprintf(stderr, "Manifeste invalide ou d'une version inconnue, il est ignoré\n");
+        munmap(mapping, info.st_size);
+        return -1;
+    }
+
+    manifest->mapping = mapping;
+    manifest->mapping_size = info.st_size;
+    manifest->header = header;
+    manifest->records = (const manifest_record_t *)((const char *)mapping + sizeof(manifest_header_t));
+    manifest->strings = (const char *)mapping + header->strings_offset;
+
+    // Chaque chemin doit tenir dans la table des chaînes et être terminé par un zéro
+    for (uint32_t i=0; i<header->entries_count; ++i) {
+        const manifest_record_t *record = &manifest->records[i];
+        if (record->path_offset + record->path_length >= header->strings_size
+            || manifest->strings[record->path_offset + record->path_length] != '\0') {
+            fprintf(stderr, "Manifeste corrompu, il est ignoré\n");
+            manifest_close(manifest);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief manifest_close unmaps a manifest
+ * @param manifest is the manifest to close
+ */
+void manifest_close(manifest_t *manifest) {
+    if (manifest != NULL && manifest->mapping != NULL) {
+        munmap(manifest->mapping, manifest->mapping_size);
+        memset(manifest, 0, sizeof(manifest_t));
+    }
+}
+
+/*!
+ * @brief manifest_record_path returns the relative path of a record
+ * @param manifest is the manifest containing the record
+ * @param record is the record
+ * @return a pointer into the mapped strings table
+ */
+const char *manifest_record_path(const manifest_t *manifest, const manifest_record_t *record) {
+    return manifest->strings + record->path_offset;
+}
+
+/*!
+ * @brief manifest_lookup looks up for a relative path, using the ordering of the records (binary search)
+ * @param manifest is the manifest to look into
+ * @param relative_path is the path relative to the root of the tree
+ * @return a pointer to the record, NULL if none were found
+ */
+const manifest_record_t *manifest_lookup(const manifest_t *manifest, const char *relative_path) {
+    if (manifest == NULL || manifest->header == NULL || relative_path == NULL) {
+        return NULL;
+    }
+    size_t low = 0, high = manifest->header->entries_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int comparison = strcmp(manifest_record_path(manifest, &manifest->records[middle]), relative_path);
+        if (comparison == 0) {
+            return &manifest->records[middle];
+        } else if (comparison < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return NULL;
+}
+
+/*!
+ * @brief manifest_to_files_list builds a files list from a manifest, in place of listing the tree
+ * @param manifest is the manifest to read
+ * @param list is the list to build (records are sorted, entries are added to its tail)
+ * @param root is the root of the tree, prepended to the relative paths
+ * @return 0 in case of success, -1 else
+ */
+int manifest_to_files_list(const manifest_t *manifest, files_list_t *list, char *root) {
+    if (manifest == NULL || manifest->header == NULL || list == NULL || root == NULL) {
+        return -1;
+    }
+    for (uint32_t i=0; i<manifest->header->entries_count; ++i) {
+        const manifest_record_t *record = &manifest->records[i];
+        files_list_entry_t *entry = malloc(sizeof(files_list_entry_t));
+        if (entry == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        memset(entry, 0, sizeof(files_list_entry_t));
+        snprintf(entry->path_and_name, sizeof(entry->path_and_name), "%s/%s", root, manifest_record_path(manifest, record));
+        entry->size = record->size;
+        entry->mtime.tv_sec = record->mtime_ns / 1000000000LL;
+        entry->mtime.tv_nsec = record->mtime_ns % 1000000000LL;
+        entry->mode = record->mode;
+        entry->entry_type = record->entry_type == DOSSIER ? DOSSIER : FICHIER;
+        memcpy(entry->md5sum, record->md5sum, sizeof(entry->md5sum));
+        add_entry_to_tail(list, entry);
+        STATS_ADD(entries_listed, 1);
+    }
+    return 0;
+}
+
+/*!
+ * @brief manifest_verify checks that the entries of the manifest still match the tree
+ * Every recorded entry is stat'ed (no directory is read): modified or deleted entries are detected,
+ * entries added to the destination by another tool are not.
+ * @param manifest is the manifest to verify
+ * @param root is the root of the tree
+ * @return true if all the entries match, false else
+ */
+bool manifest_verify(const manifest_t *manifest, char *root) {
+    if (manifest == NULL || manifest->header == NULL) {
+        return false;
+    }
+    for (uint32_t i=0; i<manifest->header->entries_count; ++i) {
+        const manifest_record_t *record = &manifest->records[i];
+        // Fichier empaqueté : il n'existe que dans les packs, c'est leur index qui fait foi
+        if (record->entry_type == FICHIER && pack_holds(manifest_record_path(manifest, record), record->size, record->mtime_ns)) {
+            continue;
+        }
+        char path[PATH_SIZE];
+        struct stat info;
+        if (concat_path(path, root, (char *)manifest_record_path(manifest, record)) == NULL || stat(path, &info) == -1) {
+            return false;
+        }
+        STATS_ADD(syscalls, 1);
+        int64_t mtime_ns = (int64_t)info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+        if (info.st_mode != record->mode || (record->entry_type == FICHIER
+            && ((uint64_t)info.st_size != record->size || mtime_ns != record->mtime_ns))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * @brief compare_entries_by_path is the qsort comparison function for entries pointers
+ */
+static int compare_entries_by_path(const void *lhd, const void *rhd) {
+    files_list_entry_t *const *left = lhd;
+    files_list_entry_t *const *right = rhd;
+    return strcmp((*left)->path_and_name, (*right)->path_and_name);
+}
+
+/*!
+ * @brief is_manifest_entry tests if an entry is the manifest file itself (it must never be synchronized)
+ * @param entry is the entry to test
+ * @param root is the root of the tree of the entry
+ * @return true if the entry is the manifest, false else
+ */
+bool is_manifest_entry(files_list_entry_t *entry, char *root) {
+    size_t root_length = strlen(root);
+    return strncmp(entry->path_and_name, root, root_length) == 0
+        && strncmp(entry->path_and_name + root_length + 1, MANIFEST_FILE_NAME, strlen(MANIFEST_FILE_NAME)) == 0;
+}
+
+/*!
+ * @brief manifest_write writes the manifest of a tree, atomically (temporary file then rename)
+ * @param list is the list of the entries of the tree, with paths starting by root
+ * @param root is the root of the tree
+ * @return 0 in case of success, -1 else
+ */
+int manifest_write(files_list_t *list, char *root) {
+    if (list == NULL || root == NULL) {
+        return -1;
+    }
+    size_t root_length = strlen(root) + 1;
+
+    // Tri par chemin relatif (identique au tri par chemin complet, la racine étant commune)
+    size_t count = 0;
+    for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
+        count++;
+    }
+    files_list_entry_t **sorted = malloc((count ? count : 1) * sizeof(files_list_entry_t *));
+    if (sorted == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    size_t kept = 0;
+    uint64_t strings_size = 0;
+    for (files_list_entry_t *cursor = list->head; cursor != NULL; cursor = cursor->next) {
+        if (strlen(cursor->path_and_name) <= root_length || is_manifest_entry(cursor, root) || is_journal_entry(cursor, root)) {
+            continue;
+        }
+        sorted[kept++] = cursor;
+        strings_size += strlen(cursor->path_and_name + root_length) + 1;
+    }
+    qsort(sorted, kept, sizeof(files_list_entry_t *), compare_entries_by_path);
+
+    // Empreintes de Merkle, pour comparer la prochaine fois les seuls sous-arbres modifiés
+    merkle_item_t *items = malloc((kept ? kept : 1) * sizeof(merkle_item_t));
+    if (items == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        free(sorted);
+        return -1;
+    }
+    for (size_t i=0; i<kept; ++i) {
+        merkle_item_from_entry(&items[i], sorted[i], root_length);
+    }
+    uint8_t root_digest[MERKLE_DIGEST_SIZE];
+    if (merkle_compute(items, kept, root_digest) == -1) {
+        printf("Erreur d'allocation mémoire\n");
+        free(items);
+        free(sorted);
+        return -1;
+    }
+
+    char manifest_path[PATH_SIZE], temporary_path[PATH_SIZE];
+    if (concat_path(manifest_path, root, MANIFEST_FILE_NAME) == NULL
+        || concat_path(temporary_path, root, MANIFEST_FILE_NAME ".tmp") == NULL) {
+        free(items);
+        free(sorted);
+        return -1;
+    }
+    FILE *output = fopen(temporary_path, "wb");
+    if (output == NULL) {
+        perror("Erreur lors de l'écriture du manifeste");
+        free(items);
+        free(sorted);
+        return -1;
+    }
+
+    manifest_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MANIFEST_MAGIC, sizeof(MANIFEST_MAGIC));
+    header.version = MANIFEST_VERSION;
+    header.entries_count = (uint32_t)kept;
+    header.strings_offset = sizeof(manifest_header_t) + kept * sizeof(manifest_record_t);
+    header.strings_size = strings_size;
+    memcpy(header.root_digest, root_digest, sizeof(header.root_digest));
+    bool failed = fwrite(&header, sizeof(header), 1, output) != 1;
+
+    uint64_t path_offset = 0;
+    for (size_t i=0; i<kept && !failed; ++i) {
+        manifest_record_t record;
+        memset(&record, 0, sizeof(record));
+        record.path_offset = path_offset;
+        record.path_length = (uint32_t)strlen(sorted[i]->path_and_name + root_length);
+        record.size = sorted[i]->size;
+        record.mtime_ns = (int64_t)sorted[i]->mtime.tv_sec * 1000000000LL + sorted[i]->mtime.tv_nsec;
+        record.mode = sorted[i]->mode;
+        record.entry_type = (uint8_t)sorted[i]->entry_type;
+        memcpy(record.md5sum, sorted[i]->md5sum, sizeof(record.md5sum));
+        memcpy(record.digest, items[i].digest, sizeof(record.digest));
+        failed = fwrite(&record, sizeof(record), 1, output) != 1;
+        path_offset += record.path_length + 1;
+    }
+    for (size_t i=0; i<kept && !failed; ++i) {
+        const char *relative_path = sorted[i]->path_and_name + root_length;
+        failed = fwrite(relative_path, strlen(relative_path) + 1, 1, output) != 1;
+    }
+    free(items);
+    free(sorted);
+
+    if (fclose(output) != 0 || failed) {
+        perror("Erreur lors de l'écriture du manifeste");
+        unlink(temporary_path);
+        return -1;
+    }
+    if (rename(temporary_path, manifest_path) == -1) {
+        perror("Erreur lors de l'installation du manifeste");
+        unlink(temporary_path);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief merkle_item_from_entry fills a Merkle item with the metadata of a files list entry
+ * @param item is the item to fill (it points to the path of the entry)
+ * @param entry is the entry
+ * @param root_length is the length of the root of the tree of the entry, separator included
+ */
+void merkle_item_from_entry(merkle_item_t *item, files_list_entry_t *entry, size_t root_length) {
+    memset(item, 0, sizeof(merkle_item_t));
+    item->relative_path = entry->path_and_name + root_length;
+    item->size = entry->size;
+    item->mtime_ns = (int64_t)entry->mtime.tv_sec * 1000000000LL + entry->mtime.tv_nsec;
+    item->mode = entry->mode;
+    item->entry_type = (uint8_t)entry->entry_type;
+    item->payload = entry;
+}
+
+/*!
+ * @brief merkle_item_from_record fills a Merkle item with a manifest record and its stored digest
+ * @param item is the item to fill (it points into the mapping of the manifest)
+ * @param manifest is the manifest containing the record
+ * @param record is the record
+ */
+void merkle_item_from_record(merkle_item_t *item, const manifest_t *manifest, const manifest_record_t *record) {
+    memset(item, 0, sizeof(merkle_item_t));
+    item->relative_path = manifest_record_path(manifest, record);
+    item->size = record->size;
+    item->mtime_ns = record->mtime_ns;
+    item->mode = record->mode;
+    item->entry_type = record->entry_type;
+    memcpy(item->digest, record->digest, sizeof(item->digest));
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <files-list.h>
+#include <merkle.h>
+
+#define MANIFEST_FILE_NAME ".lp25-manifest"
+#define MANIFEST_MAGIC "LP25MAN"
+#define MANIFEST_VERSION 2
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t entries_count;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    uint8_t root_digest[MERKLE_DIGEST_SIZE]; // Merkle digest of the whole tree
+} manifest_header_t;
+
+typedef struct {
+    uint64_t path_offset; // Offset of the relative path in the strings table
+    uint64_t size;
+    int64_t mtime_ns;
+    uint32_t path_length;
+    uint32_t mode;
+    uint8_t md5sum[16];
+    uint8_t digest[MERKLE_DIGEST_SIZE]; // Merkle digest of the entry (of its subtree for a directory)
+    uint8_t entry_type;
+    uint8_t padding[7];
+} manifest_record_t;
+
+typedef struct {
+    void *mapping;
+    size_t mapping_size;
+    const manifest_header_t *header;
+    const manifest_record_t *records;
+    const char *strings;
+} manifest_t;
+
+int manifest_open(manifest_t *manifest, char *root);
+void manifest_close(manifest_t *manifest);
+const char *manifest_record_path(const manifest_t *manifest, const manifest_record_t *record);
+const manifest_record_t *manifest_lookup(const manifest_t *manifest, const char *relative_path);
+int manifest_to_files_list(const manifest_t *manifest, files_list_t *list, char *root);
+bool manifest_verify(const manifest_t *manifest, char *root);
+int manifest_write(files_list_t *list, char *root);
+bool is_manifest_entry(files_list_entry_t *entry, char *root);
+void merkle_item_from_entry(merkle_item_t *item, files_list_entry_t *entry, size_t root_length);
+void merkle_item_from_record(merkle_item_t *item, const manifest_t *manifest, const manifest_record_t *record);
@@ -0,0 +1,222 @@
+#include <merkle.h>
+#include <files-list.h>
+#include <defines.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/md5.h>
+
+/*!
+ * @brief item_depth returns the number of '/' in the relative path of an item (0 for the root's children)
+ */
+static size_t item_depth(const merkle_item_t *item) {
+    size_t depth = 0;
+    for (const char *p = item->relative_path; *p; ++p) {
+        depth += *p == '/';
+    }
+    return depth;
+}
+
+/*!
+ * @brief find_path returns the index of a relative path in a sorted items array (binary search)
+ * @param length is the number of characters of path to compare (the path may not be terminated there)
+ * @return the index of the item, count if none were found
+ */
+static size_t find_path(merkle_item_t *items, size_t count, const char *path, size_t length) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        int comparison = strncmp(items[middle].relative_path, path, length);
+        if (comparison == 0 && items[middle].relative_path[length] != '\0') {
+            comparison = 1;
+        }
+        if (comparison == 0) {
+            return middle;
+        } else if (comparison < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return count;
+}
+
+/*!
+ * @brief hash_entry feeds the own attributes of an entry into a digest (not its children)
+ * These are the attributes compared by mismatch without MD5: the size of directories depends on the
+ * filesystem and is left out.
+ */
+static void hash_entry(MD5_CTX *context, const merkle_item_t *item) {
+    const char *name = strrchr(item->relative_path, '/');
+    name = name != NULL ? name + 1 : item->relative_path;
+    uint64_t size = item->entry_type == FICHIER ? item->size : 0;
+    MD5_Update(context, &item->entry_type, sizeof(item->entry_type));
+    MD5_Update(context, &size, sizeof(size));
+    MD5_Update(context, &item->mtime_ns, sizeof(item->mtime_ns));
+    MD5_Update(context, &item->mode, sizeof(item->mode));
+    MD5_Update(context, name, strlen(name) + 1);
+}
+
+typedef struct {
+    size_t index;
+    size_t depth;
+} depth_index_t;
+
+/*!
+ * @brief compare_depths orders items by decreasing depth, then by path (their index)
+ */
+static int compare_depths(const void *lhd, const void *rhd) {
+    const depth_index_t *left = lhd, *right = rhd;
+    if (left->depth != right->depth) {
+        return left->depth > right->depth ? -1 : 1;
+    }
+    return left->index < right->index ? -1 : left->index > right->index;
+}
+
+/*!
+ * @brief merkle_compute computes the Merkle digests of a tree, bottom-up
+ * The digest of a file covers its name and metadata; the digest of a directory
+ * covers its name, its metadata and the digests of its children in path order. Two subtrees with the
+ * same digest are identical, so a comparison never needs to descend into them.
+ * @param items is the array of the entries of the tree, sorted by relative path
+ * @param count is the number of entries
+ * @param root_digest receives the digest of the whole tree
+ * @return 0 in case of success, -1 else
+ */
+int merkle_compute(merkle_item_t *items, size_t count, uint8_t root_digest[MERKLE_DIGEST_SIZE]) {
+    depth_index_t *order = malloc((count ? count : 1) * sizeof(depth_index_t));
+    // Un contexte par élément, alimenté par les enfants (seuls ceux des dossiers servent)
+    MD5_CTX *children = malloc((count ? count : 1) * sizeof(MD5_CTX));
+    if (order == NULL || children == NULL) {
+        free(order);
+        free(children);
+        return -1;
+    }
+    for (size_t i=0; i<count; ++i) {
+        order[i].index = i;
+        order[i].depth = item_depth(&items[i]);
+        MD5_Init(&children[i]);
+    }
+    qsort(order, count, sizeof(depth_index_t), compare_depths);
+
+    // Des plus profonds aux moins profonds : un dossier est terminé quand tous ses enfants l'ont alimenté
+    MD5_CTX root;
+    MD5_Init(&root);
+    for (size_t k=0; k<count; ++k) {
+        merkle_item_t *item = &items[order[k].index];
+        MD5_CTX context;
+        MD5_Init(&context);
+        hash_entry(&context, item);
+        if (item->entry_type == DOSSIER) {
+            uint8_t children_digest[MERKLE_DIGEST_SIZE];
+            MD5_Final(children_digest, &children[order[k].index]);
+            MD5_Update(&context, children_digest, sizeof(children_digest));
+        }
+        MD5_Final(item->digest, &context);
+
+        const char *separator = strrchr(item->relative_path, '/');
+        size_t parent = separator == NULL ? count : find_path(items, count, item->relative_path, separator - item->relative_path);
+        if (separator == NULL) {
+            MD5_Update(&root, item->digest, MERKLE_DIGEST_SIZE);
+        } else if (parent < count) {
+            MD5_Update(&children[parent], item->digest, MERKLE_DIGEST_SIZE);
+        }
+    }
+    MD5_Final(root_digest, &root);
+    free(children);
+    free(order);
+    return 0;
+}
+
+/*!
+ * @brief subtree_end returns the index after the subtree of a directory (the entries prefixed by "path/")
+ * @param items is the sorted items array
+ * @param count is the number of items
+ * @param start is the index to search from
+ * @param path is the path of the directory
+ * @return the index of the first entry after the subtree
+ */
+static size_t subtree_end(merkle_item_t *items, size_t count, size_t start, const char *path) {
+    size_t length = strlen(path);
+    size_t low = start, high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const char *candidate = items[middle].relative_path;
+        // Les chemins "path/..." sont contigus ; tout chemin qui les suit compare plus grand que "path/\xff"
+        int comparison = strncmp(candidate, path, length);
+        if (comparison < 0 || (comparison == 0 && (unsigned char)candidate[length] <= '/')) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/*!
+ * @brief skip_identical moves a cursor over the subtrees of identical directories
+ * An entry is skipped if one of its ancestors was found identical on both sides.
+ * @return the new position of the cursor
+ */
+static size_t skip_identical(merkle_item_t *items, size_t count, size_t cursor) {
+    while (cursor < count) {
+        const char *path = items[cursor].relative_path;
+        size_t skip_to = cursor;
+        for (const char *separator = strchr(path, '/'); separator != NULL; separator = strchr(separator + 1, '/')) {
+            size_t ancestor = find_path(items, count, path, separator - path);
+            if (ancestor < count && items[ancestor].skipped) {
+                char ancestor_path[PATH_SIZE];
+                snprintf(ancestor_path, sizeof(ancestor_path), "%.*s", (int)(separator - path), path);
+                skip_to = subtree_end(items, count, cursor, ancestor_path);
+                break;
+            }
+        }
+        if (skip_to == cursor) {
+            return cursor;
+        }
+        cursor = skip_to;
+    }
+    return cursor;
+}
+
+/*!
+ * @brief merkle_diff compares two trees top-down, using their Merkle digests (@see merkle_compute)
+ * Both arrays are walked together in path order; when a directory has the same digest on both sides, its
+ * whole subtree is jumped over with a binary search. The cost depends on the changes, not on the size.
+ * @param left is the first tree (sorted items with digests)
+ * @param left_count is the number of items of the first tree
+ * @param right is the second tree
+ * @param right_count is the number of items of the second tree
+ * @param report is called for each entry that differs: (left, right), (left, NULL) or (NULL, right)
+ * @param context is passed to report
+ */
+void merkle_diff(merkle_item_t *left, size_t left_count, merkle_item_t *right, size_t right_count, merkle_report_t report, void *context) {
+    for (size_t i=0; i<left_count; ++i) {
+        left[i].skipped = false;
+    }
+    for (size_t j=0; j<right_count; ++j) {
+        right[j].skipped = false;
+    }
+    size_t i = 0, j = 0;
+    while (true) {
+        i = skip_identical(left, left_count, i);
+        j = skip_identical(right, right_count, j);
+        if (i >= left_count && j >= right_count) {
+            break;
+        }
+        int comparison = i >= left_count ? 1 : j >= right_count ? -1 : strcmp(left[i].relative_path, right[j].relative_path);
+        if (comparison < 0) {
+            report(&left[i++], NULL, context);
+        } else if (comparison > 0) {
+            report(NULL, &right[j++], context);
+        } else {
+            if (memcmp(left[i].digest, right[j].digest, MERKLE_DIGEST_SIZE) == 0) {
+                left[i].skipped = right[j].skipped = true;
+            } else {
+                report(&left[i], &right[j], context);
+            }
+            i++;
+            j++;
+        }
+    }
+}
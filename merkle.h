@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define MERKLE_DIGEST_SIZE 16
+
+// One entry of a tree, in an array sorted by relative path (strcmp order)
+typedef struct {
+    const char *relative_path;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint32_t mode;
+    uint8_t entry_type;
+    bool skipped;
+    uint8_t digest[MERKLE_DIGEST_SIZE]; // Files: digest of the entry; directories: digest of the whole subtree
+    void *payload; // Entry the item was built from
+} merkle_item_t;
+
+typedef void (*merkle_report_t)(merkle_item_t *left, merkle_item_t *right, void *context);
+
+int merkle_compute(merkle_item_t *items, size_t count, uint8_t root_digest[MERKLE_DIGEST_SIZE]);
+void merkle_diff(merkle_item_t *left, size_t left_count, merkle_item_t *right, size_t right_count, merkle_report_t report, void *context);
@@ -1,6 +1,7 @@
 #include <messages.h>
 #include <sys/msg.h>
 #include <string.h>
+#include <trace.h>
 
 // Functions in this file are required for inter processes communication
 
@@ -30,7 +31,9 @@ int send_file_entry(int msg_queue, int recipient, files_list_entry_t *file_entry
   memcpy(&msg.list_entry.payload, file_entry, sizeof(files_list_entry_t));
 
   //Envoi du message
+  TRACE_BEGIN("msg_send", "ipc");
   int snd = msgsnd(msg_queue, &msg, sizeof(msg) - sizeof(long), 0);
+  TRACE_END("msg_send", "ipc");
 
   //Vérification de la réussite ou non de l'envoi du message
   if (snd == -1) {
@@ -66,7 +69,9 @@ int send_analyze_dir_command(int msg_queue, int recipient, char *target_dir) {
   cmd.target[sizeof(cmd.target) - 1] = '\0'; // Assure la terminaison nulle
 
   //Envoi de la commande
+  TRACE_BEGIN("msg_send", "ipc");
   int snd = msgsnd(msg_queue, &cmd, sizeof(cmd) - sizeof(long), 0);
+  TRACE_END("msg_send", "ipc");
 
   //Vérification de la réussite ou non de l'envoi de la commande
   if (snd == -1) {
@@ -0,0 +1,173 @@
+#include <metadata.h>
+#include <stats.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <defines.h>
+#include <sys/stat.h>
+
+typedef struct {
+    char *path;
+    mode_t mode;
+    struct timespec mtime;
+} deferred_directory_t;
+
+// Fin d'un enregistrement du fichier de débordement, écrit après le chemin : le fichier se relit à l'envers
+typedef struct {
+    mode_t mode;
+    struct timespec mtime;
+    size_t path_length;
+} spilled_directory_t;
+
+// Dossiers créés ou modifiés pendant la copie, dans l'ordre de la copie (parents avant enfants)
+static deferred_directory_t *directories = NULL;
+static size_t directories_count = 0;
+static size_t directories_capacity = 0;
+// Avec une mémoire bornée, les dossiers suivants sont écrits dans un fichier temporaire (@see metadata_spill_directories)
+static FILE *spill = NULL;
+
+/*!
+ * @brief metadata_apply_fd applies the mode and the modification time of a source file to an open destination file
+ * Working on the fd avoids resolving the path again and applies to the file that was actually written.
+ * @param fd is the file descriptor of the destination file
+ * @param mode is the mode of the source file
+ * @param mtime is the modification time of the source file (nanoseconds precision)
+ * @return 0 in case of success, -1 else
+ */
+int metadata_apply_fd(int fd, mode_t mode, struct timespec *mtime) {
+    // L'heure d'accès n'est pas modifiée
+    struct timespec times[2] = {{0, UTIME_OMIT}, *mtime};
+    STATS_ADD(syscalls, 2);
+    if (fchmod(fd, mode & 07777) == -1 || futimens(fd, times) == -1) {
+        perror("Erreur lors de l'application des métadonnées");
+        STATS_ADD(errors, 1);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief metadata_defer_directory records the metadata to apply to a destination directory once its content is written
+ * Writing children changes the mtime of a directory, and a read-only mode would prevent writing them:
+ * both are applied by metadata_apply_directories after the copy.
+ * @param path is the path of the destination directory
+ * @param mode is the mode of the source directory
+ * @param mtime is the modification time of the source directory
+ * @return 0 in case of success, -1 else
+ */
+int metadata_defer_directory(const char *path, mode_t mode, struct timespec *mtime) {
+    if (spill != NULL) {
+        spilled_directory_t record = {mode, *mtime, strlen(path)};
+        if (fwrite(path, 1, record.path_length, spill) != record.path_length || fwrite(&record, sizeof(record), 1, spill) != 1) {
+            perror("Erreur lors de l'écriture des métadonnées différées");
+            STATS_ADD(errors, 1);
+            return -1;
+        }
+        return 0;
+    }
+    if (directories_count == directories_capacity) {
+        size_t capacity = directories_capacity ? directories_capacity * 2 : 64;
+        deferred_directory_t *resized = realloc(directories, capacity * sizeof(deferred_directory_t));
+        if (resized == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        directories = resized;
+        directories_capacity = capacity;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        return -1;
+    }
+    directories[directories_count].path = copy;
+    directories[directories_count].mode = mode;
+    directories[directories_count].mtime = *mtime;
+    directories_count++;
+    return 0;
+}
+
+/*!
+ * @brief metadata_spill_directories makes the next deferred directories be written to a temporary file
+ * Used when the memory is bounded (--memory-limit): the memory used no longer grows with the number of directories.
+ * @return 0 in case of success, -1 else (directories are then kept in memory)
+ */
+int metadata_spill_directories(void) {
+    if (spill == NULL && (spill = tmpfile()) == NULL) {
+        perror("Erreur lors de la création du fichier des métadonnées différées");
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief apply_directory applies the deferred metadata of one directory
+ * @return 0 in case of success, -1 else
+ */
+static int apply_directory(const char *path, mode_t mode, struct timespec mtime) {
+    struct timespec times[2] = {{0, UTIME_OMIT}, mtime};
+    STATS_ADD(syscalls, 2);
+    if (chmod(path, mode & 07777) == -1 || utimensat(AT_FDCWD, path, times, 0) == -1) {
+        perror("Erreur lors de l'application des métadonnées du dossier");
+        STATS_ADD(errors, 1);
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief apply_spilled_directories applies the directories of the temporary file, from its end, then closes it
+ * @return the number of directories whose metadata could not be applied
+ */
+static int apply_spilled_directories(void) {
+    int failures = 0;
+    char path[PATH_SIZE];
+    spilled_directory_t record;
+    if (fflush(spill) != 0) {
+        perror("Erreur lors de la relecture des métadonnées différées");
+        failures++;
+    }
+    off_t end = failures == 0 ? ftello(spill) : 0;
+    while (end >= (off_t)sizeof(record)) {
+        STATS_ADD(syscalls, 2);
+        if (pread(fileno(spill), &record, sizeof(record), end - sizeof(record)) != (ssize_t)sizeof(record)
+            || record.path_length >= sizeof(path) || end < (off_t)(sizeof(record) + record.path_length)
+            || pread(fileno(spill), path, record.path_length, end - sizeof(record) - record.path_length) != (ssize_t)record.path_length) {
+            perror("Erreur lors de la relecture des métadonnées différées");
+            STATS_ADD(errors, 1);
+            failures++;
+            break;
+        }
+        path[record.path_length] = '\0';
+        if (apply_directory(path, record.mode, record.mtime) == -1) {
+            failures++;
+        }
+        end -= sizeof(record) + record.path_length;
+    }
+    fclose(spill);
+    spill = NULL;
+    return failures;
+}
+
+/*!
+ * @brief metadata_apply_directories applies the deferred metadata of directories, bottom-up
+ * Directories were recorded parents first: walking the records backwards handles children before their parent.
+ * The spilled directories were recorded last, they are applied first.
+ * @return the number of directories whose metadata could not be applied
+ */
+int metadata_apply_directories(void) {
+    int failures = spill != NULL ? apply_spilled_directories() : 0;
+    for (size_t i=directories_count; i>0; --i) {
+        deferred_directory_t *directory = &directories[i - 1];
+        if (apply_directory(directory->path, directory->mode, directory->mtime) == -1) {
+            failures++;
+        }
+        free(directory->path);
+    }
+    free(directories);
+    directories = NULL;
+    directories_count = 0;
+    directories_capacity = 0;
+    return failures;
+}
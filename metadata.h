@@ -0,0 +1,9 @@
+#pragma once
+
+#include <sys/types.h>
+#include <time.h>
+
+int metadata_apply_fd(int fd, mode_t mode, struct timespec *mtime);
+int metadata_defer_directory(const char *path, mode_t mode, struct timespec *mtime);
+int metadata_spill_directories(void);
+int metadata_apply_directories(void);
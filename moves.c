@@ -0,0 +1,293 @@
+#include <moves.h>
+#include <file-properties.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef struct {
+    const char *source_path; // Path of the source entry (in the differences list)
+    files_list_entry_t *destination_entry; // Destination-only entry to rename
+    bool done;
+} planned_move_t;
+
+static planned_move_t *moves = NULL;
+static size_t moves_count = 0;
+
+// Longueurs des racines, pour comparer les chemins relatifs dans qsort
+static size_t start_of_src = 0;
+static size_t start_of_dest = 0;
+
+/*!
+ * @brief compare_destination_paths compares two destination entries by relative path
+ */
+static int compare_destination_paths(const void *lhd, const void *rhd) {
+    files_list_entry_t *const *left = lhd;
+    files_list_entry_t *const *right = rhd;
+    return strcmp((*left)->path_and_name + start_of_dest, (*right)->path_and_name + start_of_dest);
+}
+
+/*!
+ * @brief compare_source_paths compares two source entries by relative path
+ */
+static int compare_source_paths(const void *lhd, const void *rhd) {
+    files_list_entry_t *const *left = lhd;
+    files_list_entry_t *const *right = rhd;
+    return strcmp((*left)->path_and_name + start_of_src, (*right)->path_and_name + start_of_src);
+}
+
+/*!
+ * @brief compare_destination_to_source compares a destination relative path to a source entry (bsearch)
+ */
+static int compare_destination_to_source(const void *key, const void *element) {
+    files_list_entry_t *const *source_entry = element;
+    return strcmp((const char *)key, (*source_entry)->path_and_name + start_of_src);
+}
+
+/*!
+ * @brief compare_source_to_destination compares a source relative path to a destination entry (bsearch)
+ */
+static int compare_source_to_destination(const void *key, const void *element) {
+    files_list_entry_t *const *destination_entry = element;
+    return strcmp((const char *)key, (*destination_entry)->path_and_name + start_of_dest);
+}
+
+/*!
+ * @brief compare_contents_keys orders destination entries by size, then mtime
+ */
+static int compare_contents_keys(const void *lhd, const void *rhd) {
+    files_list_entry_t *left = *(files_list_entry_t *const *)lhd;
+    files_list_entry_t *right = *(files_list_entry_t *const *)rhd;
+    if (left->size != right->size) {
+        return left->size < right->size ? -1 : 1;
+    }
+    if (left->mtime.tv_sec != right->mtime.tv_sec) {
+        return left->mtime.tv_sec < right->mtime.tv_sec ? -1 : 1;
+    }
+    if (left->mtime.tv_nsec != right->mtime.tv_nsec) {
+        return left->mtime.tv_nsec < right->mtime.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief compare_planned_moves orders planned moves by source path
+ */
+static int compare_planned_moves(const void *lhd, const void *rhd) {
+    return strcmp(((const planned_move_t *)lhd)->source_path, ((const planned_move_t *)rhd)->source_path);
+}
+
+/*!
+ * @brief same_content tells if a destination-only file holds the content of a source file
+ * Size and mtime (preserved by the copy) must match; with MD5 enabled, the digests are compared too.
+ * @param source_entry is the source file
+ * @param destination_entry is the candidate destination file
+ * @param uses_md5 is true when MD5 sums must be compared
+ * @return true if the candidate can be renamed in place of a copy
+ */
+static bool same_content(files_list_entry_t *source_entry, files_list_entry_t *destination_entry, bool uses_md5) {
+    if (compare_contents_keys(&source_entry, &destination_entry) != 0) {
+        return false;
+    }
+    if (!uses_md5) {
+        return true;
+    }
+    return compute_file_md5(source_entry) == 0 && compute_file_md5(destination_entry) == 0
+        && memcmp(source_entry->md5sum, destination_entry->md5sum, sizeof(source_entry->md5sum)) == 0;
+}
+
+/*!
+ * @brief moves_plan detects files of the differences list that were moved or renamed in the source
+ * Destination-only files are indexed by size and mtime; each new source file matching one of them is
+ * planned as a rename of that file inside the destination (@see moves_find), instead of a copy.
+ * @param source is the source list
+ * @param destination is the destination list
+ * @param difference is the differences list
+ * @param the_config is a pointer to the configuration
+ * @return the number of planned moves, -1 in case of error
+ */
+int moves_plan(files_list_t *source, files_list_t *destination, files_list_t *difference, configuration_t *the_config) {
+    moves_clear();
+    start_of_src = strlen(the_config->source) + 1;
+    start_of_dest = strlen(the_config->destination) + 1;
+
+    size_t destination_count = 0, source_count = 0, difference_count = 0;
+    for (files_list_entry_t *cursor = destination->head; cursor != NULL; cursor = cursor->next) {
+        destination_count++;
+    }
+    for (files_list_entry_t *cursor = source->head; cursor != NULL; cursor = cursor->next) {
+        source_count++;
+    }
+    for (files_list_entry_t *cursor = difference->head; cursor != NULL; cursor = cursor->next) {
+        difference_count++;
+    }
+    if (destination_count == 0 || difference_count == 0) {
+        return 0;
+    }
+
+    files_list_entry_t **by_path = malloc(destination_count * sizeof(files_list_entry_t *));
+    files_list_entry_t **source_by_path = malloc((source_count ? source_count : 1) * sizeof(files_list_entry_t *));
+    files_list_entry_t **candidates = malloc(destination_count * sizeof(files_list_entry_t *));
+    bool *used = calloc(destination_count, sizeof(bool));
+    moves = malloc(difference_count * sizeof(planned_move_t));
+    if (by_path == NULL || source_by_path == NULL || candidates == NULL || used == NULL || moves == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        free(by_path);
+        free(source_by_path);
+        free(candidates);
+        free(used);
+        moves_clear();
+        return -1;
+    }
+    size_t i = 0;
+    for (files_list_entry_t *cursor = destination->head; cursor != NULL; cursor = cursor->next) {
+        by_path[i++] = cursor;
+    }
+    qsort(by_path, destination_count, sizeof(files_list_entry_t *), compare_destination_paths);
+    i = 0;
+    for (files_list_entry_t *cursor = source->head; cursor != NULL; cursor = cursor->next) {
+        source_by_path[i++] = cursor;
+    }
+    qsort(source_by_path, source_count, sizeof(files_list_entry_t *), compare_source_paths);
+
+    // Fichiers présents seulement dans la destination : candidats au déplacement
+    size_t candidates_count = 0;
+    for (size_t d=0; d<destination_count; ++d) {
+        if (by_path[d]->entry_type == FICHIER
+            && bsearch(by_path[d]->path_and_name + start_of_dest, source_by_path, source_count, sizeof(files_list_entry_t *), compare_destination_to_source) == NULL) {
+            candidates[candidates_count++] = by_path[d];
+        }
+    }
+    qsort(candidates, candidates_count, sizeof(files_list_entry_t *), compare_contents_keys);
+
+    for (files_list_entry_t *cursor = difference->head; cursor != NULL && candidates_count > 0; cursor = cursor->next) {
+        if (cursor->entry_type != FICHIER
+            || bsearch(cursor->path_and_name + start_of_src, by_path, destination_count, sizeof(files_list_entry_t *), compare_source_to_destination) != NULL) {
+            continue; // Fichier modifié, et non nouveau
+        }
+        // Premier candidat de même clé (taille, date), puis les suivants s'ils sont déjà pris
+        size_t low = 0, high = candidates_count;
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+            if (compare_contents_keys(&candidates[middle], &cursor) < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        for (size_t c=low; c<candidates_count && compare_contents_keys(&candidates[c], &cursor) == 0; ++c) {
+            if (!used[c] && same_content(cursor, candidates[c], the_config->uses_md5)) {
+                used[c] = true;
+                moves[moves_count].source_path = cursor->path_and_name;
+                moves[moves_count].destination_entry = candidates[c];
+                moves[moves_count].done = false;
+                moves_count++;
+                break;
+            }
+        }
+    }
+    qsort(moves, moves_count, sizeof(planned_move_t), compare_planned_moves);
+
+    free(by_path);
+    free(source_by_path);
+    free(candidates);
+    free(used);
+    return (int)moves_count;
+}
+
+/*!
+ * @brief find_move looks up for the planned move of a source entry
+ */
+static planned_move_t *find_move(files_list_entry_t *source_entry) {
+    if (source_entry == NULL || moves_count == 0) {
+        return NULL;
+    }
+    planned_move_t key = {source_entry->path_and_name, NULL, false};
+    return bsearch(&key, moves, moves_count, sizeof(planned_move_t), compare_planned_moves);
+}
+
+/*!
+ * @brief moves_find returns the destination file to rename in place of copying a source entry
+ * @param source_entry is the source entry about to be copied
+ * @return the path of the destination file holding the same content, NULL if there is none
+ */
+const char *moves_find(files_list_entry_t *source_entry) {
+    planned_move_t *move = find_move(source_entry);
+    if (move == NULL || move->done) {
+        return NULL;
+    }
+    return move->destination_entry->path_and_name;
+}
+
+/*!
+ * @brief moves_done marks the move of a source entry as performed
+ * @param source_entry is the source entry whose destination file was renamed
+ */
+void moves_done(files_list_entry_t *source_entry) {
+    planned_move_t *move = find_move(source_entry);
+    if (move != NULL) {
+        move->done = true;
+    }
+}
+
+/*!
+ * @brief compare_pointers orders entries pointers by address
+ */
+static int compare_pointers(const void *lhd, const void *rhd) {
+    uintptr_t left = (uintptr_t)*(files_list_entry_t *const *)lhd;
+    uintptr_t right = (uintptr_t)*(files_list_entry_t *const *)rhd;
+    return (left > right) - (left < right);
+}
+
+/*!
+ * @brief moves_prune_destination removes from the destination list the entries that were renamed
+ * @param destination is the destination list, whose entries still have their former paths
+ */
+void moves_prune_destination(files_list_t *destination) {
+    // Entrées renommées, triées par adresse pour la recherche
+    size_t moved_count = 0;
+    files_list_entry_t **moved = malloc((moves_count ? moves_count : 1) * sizeof(files_list_entry_t *));
+    for (size_t i=0; i<moves_count && moved != NULL; ++i) {
+        if (moves[i].done) {
+            moved[moved_count++] = moves[i].destination_entry;
+        }
+    }
+    if (moved != NULL) {
+        qsort(moved, moved_count, sizeof(files_list_entry_t *), compare_pointers);
+    }
+
+    // Les pointeurs prev ne sont pas fiables sur toutes les listes : la liste est reconstruite en avançant
+    files_list_entry_t *previous = NULL;
+    files_list_entry_t *cursor = destination->head;
+    destination->head = NULL;
+    while (cursor != NULL) {
+        files_list_entry_t *next = cursor->next;
+        if (moved != NULL && bsearch(&cursor, moved, moved_count, sizeof(files_list_entry_t *), compare_pointers) != NULL) {
+            free(cursor);
+        } else {
+            cursor->prev = previous;
+            if (previous == NULL) {
+                destination->head = cursor;
+            } else {
+                previous->next = cursor;
+            }
+            previous = cursor;
+        }
+        cursor = next;
+    }
+    if (previous != NULL) {
+        previous->next = NULL;
+    }
+    destination->tail = previous;
+    free(moved);
+    moves_clear();
+}
+
+/*!
+ * @brief moves_clear forgets all planned moves
+ */
+void moves_clear(void) {
+    free(moves);
+    moves = NULL;
+    moves_count = 0;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <files-list.h>
+#include <configuration.h>
+
+int moves_plan(files_list_t *source, files_list_t *destination, files_list_t *difference, configuration_t *the_config);
+const char *moves_find(files_list_entry_t *source_entry);
+void moves_done(files_list_entry_t *source_entry);
+void moves_prune_destination(files_list_t *destination);
+void moves_clear(void);
@@ -0,0 +1,563 @@
+#include <pack.h>
+#include <stats.h>
+#include <trace.h>
+#include <ratelimit.h>
+#include <utility.h>
+#include <defines.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <openssl/md5.h>
+
+typedef struct {
+    char *path; // Chemin relatif à la racine de la destination
+    pack_record_header_t header; // Dernier enregistrement de l'index pour ce chemin
+} pack_slot_t;
+
+bool pack_enabled = false;
+static uint64_t pack_threshold = 0;
+static bool pack_durable = false;
+static char destination_root[PATH_SIZE];
+static char pack_root[PATH_SIZE];
+// Table à adressage ouvert : chemin relatif -> dernier enregistrement de l'index
+static pack_slot_t *slots = NULL;
+static size_t slots_capacity = 0;
+static size_t slots_used = 0;
+// Index : longueur valide à la lecture, puis enregistrements en attente d'écriture
+static int index_fd = -1;
+static off_t index_length = 0;
+static uint8_t *index_buffer = NULL;
+static size_t index_buffered = 0;
+// Pack en cours d'écriture : données en attente à la suite de pack_size octets déjà écrits
+static int pack_fd = -1;
+static uint32_t pack_number = 0;
+static uint64_t pack_size = 0;
+static uint8_t *pack_buffer = NULL;
+static size_t pack_buffered = 0;
+// Fichiers ordinaires remplacés par leur version empaquetée : supprimés une fois l'index écrit
+static char **pending_removals = NULL;
+static size_t pending_count = 0;
+static size_t pending_capacity = 0;
+
+/*!
+ * @brief path_hash is the FNV-1a hash of a path
+ */
+static size_t path_hash(const char *path) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const unsigned char *p = (const unsigned char *)path; *p; ++p) {
+        hash = (hash ^ *p) * 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+/*!
+ * @brief find_slot returns the slot of a path, or the free slot where to insert it
+ */
+static pack_slot_t *find_slot(const char *path) {
+    size_t index = path_hash(path) & (slots_capacity - 1);
+    while (slots[index].path != NULL && strcmp(slots[index].path, path) != 0) {
+        index = (index + 1) & (slots_capacity - 1);
+    }
+    return &slots[index];
+}
+
+/*!
+ * @brief update_slot records the latest index record of a path in the table
+ * @return 0 in case of success, -1 else
+ */
+static int update_slot(const char *path, pack_record_header_t *header) {
+    // Agrandissement à 50 % de remplissage
+    if (2 * (slots_used + 1) > slots_capacity) {
+        size_t old_capacity = slots_capacity;
+        pack_slot_t *old_slots = slots;
+        slots_capacity = old_capacity ? old_capacity * 2 : 1024;
+        slots = calloc(slots_capacity, sizeof(pack_slot_t));
+        if (slots == NULL) {
+            slots = old_slots;
+            slots_capacity = old_capacity;
+            return -1;
+        }
+        for (size_t i=0; i<old_capacity; ++i) {
+            if (old_slots[i].path != NULL) {
+                *find_slot(old_slots[i].path) = old_slots[i];
+            }
+        }
+        free(old_slots);
+    }
+    pack_slot_t *slot = find_slot(path);
+    if (slot->path == NULL) {
+        slot->path = strdup(path);
+        if (slot->path == NULL) {
+            return -1;
+        }
+        slots_used++;
+    }
+    slot->header = *header;
+    return 0;
+}
+
+/*!
+ * @brief lookup returns the slot of a path currently stored in a pack
+ * @return the slot, NULL if the path is not packed
+ */
+static pack_slot_t *lookup(const char *relative_path) {
+    if (slots_used == 0 || relative_path == NULL) {
+        return NULL;
+    }
+    pack_slot_t *slot = find_slot(relative_path);
+    return slot->path != NULL && slot->header.type == PACK_STORED ? slot : NULL;
+}
+
+/*!
+ * @brief load_index reads the index of the packs of the destination
+ * A record cut by an interruption ends the reading: the records before it are kept, and the next
+ * records will be written over it. Records are written after the data they point to, so that
+ * a read record always points to written data.
+ * @return 0 in case of success, -1 else
+ */
+static int load_index(void) {
+    char index_path[PATH_SIZE];
+    if (concat_path(index_path, pack_root, PACK_INDEX_NAME) == NULL) {
+        return -1;
+    }
+    FILE *file = fopen(index_path, "rb");
+    if (file == NULL) {
+        return 0; // Pas d'index : aucun fichier empaqueté dans la destination
+    }
+    pack_record_header_t header;
+    char path[PATH_SIZE];
+    while (fread(&header, sizeof(header), 1, file) == 1) {
+        if (header.magic != PACK_RECORD_MAGIC || header.path_length >= PATH_SIZE
+            || fread(path, 1, header.path_length, file) != header.path_length) {
+            break;
+        }
+        path[header.path_length] = '\0';
+        if (update_slot(path, &header) == -1) {
+            fclose(file);
+            return -1;
+        }
+        index_length += sizeof(header) + header.path_length;
+        // Les ajouts reprennent dans le dernier pack utilisé
+        if (header.type == PACK_STORED && header.pack_number > pack_number) {
+            pack_number = header.pack_number;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+/*!
+ * @brief pack_open loads the index of the packs of the destination
+ * Nothing is created in the destination until a file is packed (dry runs only read the index).
+ * @param destination is the root of the destination
+ * @param threshold is the size under which files are packed
+ * @param durable is true if the packs must be synced before the index records pointing into them
+ * @return 0 in case of success, -1 else
+ */
+int pack_open(char *destination, uint64_t threshold, bool durable) {
+    if (concat_path(pack_root, destination, PACK_DIRECTORY_NAME) == NULL) {
+        return -1;
+    }
+    strcpy(destination_root, destination);
+    pack_threshold = threshold;
+    pack_durable = durable;
+    if (load_index() == -1) {
+        printf("Erreur lors de la lecture de l'index des packs\n");
+        pack_close();
+        return -1;
+    }
+    pack_enabled = true;
+    return 0;
+}
+
+/*!
+ * @brief pack_accepts tests if a source entry is small enough to be packed
+ * @param source_entry is the source entry
+ * @return true if the entry goes into a pack, false if it is copied as a regular file
+ */
+bool pack_accepts(files_list_entry_t *source_entry) {
+    return pack_enabled && source_entry != NULL && source_entry->entry_type == FICHIER && source_entry->size < pack_threshold;
+}
+
+/*!
+ * @brief pack_holds tests if a version of a file is the one stored in the packs
+ * @param relative_path is the path of the file, relative to the destination
+ * @param size is the size of the version
+ * @param mtime_ns is the modification date of the version, in nanoseconds
+ * @return true if the packs hold this version of the file, false else
+ */
+bool pack_holds(const char *relative_path, uint64_t size, int64_t mtime_ns) {
+    pack_slot_t *slot = lookup(relative_path);
+    return slot != NULL && slot->header.size == size && slot->header.mtime_ns == mtime_ns;
+}
+
+/*!
+ * @brief pack_add_to_list adds the packed files to a destination list, as if they were regular files
+ * The index gives their size, date, mode and MD5 sum: they are compared with the source as usual.
+ * @param list is the destination list
+ * @param root is the root of the destination
+ * @return 0 in case of success, -1 else
+ */
+int pack_add_to_list(files_list_t *list, char *root) {
+    for (size_t i=0; i<slots_capacity; ++i) {
+        if (slots[i].path == NULL || slots[i].header.type != PACK_STORED) {
+            continue;
+        }
+        files_list_entry_t *entry = malloc(sizeof(files_list_entry_t));
+        if (entry == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        memset(entry, 0, sizeof(files_list_entry_t));
+        snprintf(entry->path_and_name, sizeof(entry->path_and_name), "%s/%s", root, slots[i].path);
+        entry->size = slots[i].header.size;
+        entry->mtime.tv_sec = slots[i].header.mtime_ns / 1000000000LL;
+        entry->mtime.tv_nsec = slots[i].header.mtime_ns % 1000000000LL;
+        entry->mode = slots[i].header.mode;
+        entry->entry_type = FICHIER;
+        memcpy(entry->md5sum, slots[i].header.md5sum, sizeof(entry->md5sum));
+        add_entry_to_tail(list, entry);
+        STATS_ADD(entries_listed, 1);
+    }
+    return 0;
+}
+
+/*!
+ * @brief prepare_writing creates the packs directory and opens the index, before the first record
+ * @return 0 in case of success, -1 else
+ */
+static int prepare_writing(void) {
+    if (index_fd != -1) {
+        return 0;
+    }
+    char index_path[PATH_SIZE];
+    STATS_ADD(syscalls, 2);
+    if ((mkdir(pack_root, 0755) == -1 && errno != EEXIST) || concat_path(index_path, pack_root, PACK_INDEX_NAME) == NULL) {
+        perror("Erreur dans la création du dossier des packs");
+        return -1;
+    }
+    index_fd = open(index_path, O_WRONLY | O_CREAT, 0644);
+    if (index_fd == -1 || ftruncate(index_fd, index_length) == -1 || lseek(index_fd, index_length, SEEK_SET) == -1) {
+        perror("Erreur lors de l'ouverture de l'index des packs");
+        if (index_fd != -1) {
+            close(index_fd);
+            index_fd = -1;
+        }
+        return -1;
+    }
+    index_buffer = malloc(PACK_BUFFER_SIZE);
+    pack_buffer = malloc(PACK_BUFFER_SIZE);
+    if (index_buffer == NULL || pack_buffer == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief write_all writes a whole buffer to a file descriptor
+ * @return 0 in case of success, -1 else
+ */
+static int write_all(int fd, const uint8_t *buffer, size_t length) {
+    while (length > 0) {
+        RATELIMIT(length);
+        ssize_t written = write(fd, buffer, length);
+        STATS_ADD(syscalls, 1);
+        if (written <= 0) {
+            return -1;
+        }
+        buffer += written;
+        length -= (size_t)written;
+    }
+    return 0;
+}
+
+/*!
+ * @brief open_pack opens the pack receiving the next files, starting a new one when it is full
+ * @return 0 in case of success, -1 else
+ */
+static int open_pack(void) {
+    while (pack_fd == -1) {
+        char pack_name[32], pack_path[PATH_SIZE];
+        snprintf(pack_name, sizeof(pack_name), "pack-%06u", pack_number);
+        if (concat_path(pack_path, pack_root, pack_name) == NULL) {
+            return -1;
+        }
+        pack_fd = open(pack_path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        STATS_ADD(syscalls, 2);
+        struct stat info;
+        if (pack_fd == -1 || fstat(pack_fd, &info) == -1) {
+            perror("Erreur lors de l'ouverture d'un pack");
+            return -1;
+        }
+        // Les données d'une exécution interrompue, sans enregistrement dans l'index, sont conservées et ignorées
+        pack_size = (uint64_t)info.st_size;
+        if (pack_size >= PACK_MAX_SIZE) {
+            close(pack_fd);
+            pack_fd = -1;
+            pack_number++;
+        }
+    }
+    return 0;
+}
+
+/*!
+ * @brief flush_pack writes the buffered data of the current pack
+ * @return 0 in case of success, -1 else
+ */
+static int flush_pack(void) {
+    if (pack_buffered == 0) {
+        return 0;
+    }
+    TRACE_BEGIN("pack_write", "pack");
+    int result = write_all(pack_fd, pack_buffer, pack_buffered);
+    if (result == 0) {
+        pack_size += pack_buffered;
+        pack_buffered = 0;
+    } else {
+        perror("Erreur lors de l'écriture d'un pack");
+    }
+    TRACE_END("pack_write", "pack");
+    return result;
+}
+
+/*!
+ * @brief remove_replaced_files removes the regular files whose packed version is now recorded in the index
+ */
+static void remove_replaced_files(void) {
+    for (size_t i=0; i<pending_count; ++i) {
+        char destination_file_path[PATH_SIZE];
+        if (concat_path(destination_file_path, destination_root, pending_removals[i]) != NULL) {
+            STATS_ADD(syscalls, 1);
+            unlink(destination_file_path);
+        }
+        free(pending_removals[i]);
+    }
+    pending_count = 0;
+}
+
+/*!
+ * @brief flush_index writes the buffered index records, after the data they point to
+ * With a durability mode, the pack is synced before the records are written, and the index before the
+ * regular files replaced by packed ones are removed: a crash never leaves a file without a copy.
+ * @return 0 in case of success, -1 else
+ */
+static int flush_index(void) {
+    if (index_buffered == 0) {
+        return 0;
+    }
+    if (flush_pack() == -1) {
+        return -1;
+    }
+    STATS_ADD(syscalls, 1);
+    if (pack_durable && pack_fd != -1 && fdatasync(pack_fd) == -1) {
+        perror("Erreur lors de la synchronisation d'un pack");
+        return -1;
+    }
+    if (write_all(index_fd, index_buffer, index_buffered) == -1) {
+        perror("Erreur lors de l'écriture de l'index des packs");
+        return -1;
+    }
+    index_length += index_buffered;
+    index_buffered = 0;
+    STATS_ADD(syscalls, 1);
+    if (pack_durable && fdatasync(index_fd) == -1) {
+        perror("Erreur lors de la synchronisation de l'index des packs");
+        return -1;
+    }
+    remove_replaced_files();
+    return 0;
+}
+
+/*!
+ * @brief append_record adds a record to the index buffer and to the table
+ * @return 0 in case of success, -1 else
+ */
+static int append_record(const char *relative_path, pack_record_header_t *header) {
+    header->magic = PACK_RECORD_MAGIC;
+    header->path_length = (uint16_t)strlen(relative_path);
+    size_t length = sizeof(pack_record_header_t) + header->path_length;
+    if (index_buffered + length > PACK_BUFFER_SIZE && flush_index() == -1) {
+        return -1;
+    }
+    memcpy(index_buffer + index_buffered, header, sizeof(pack_record_header_t));
+    memcpy(index_buffer + index_buffered + sizeof(pack_record_header_t), relative_path, header->path_length);
+    index_buffered += length;
+    return update_slot(relative_path, header);
+}
+
+/*!
+ * @brief pack_store_file appends a source file to the current pack, and records it in the index
+ * Its MD5 sum is computed on the way and stored in the source entry (and in the index).
+ * A regular file left at its path in the destination is removed once the record replacing it is written.
+ * @param source_entry is the source entry of the file
+ * @param relative_path is the path of the file, relative to the source and destination roots
+ * @return 0 in case of success, -1 else
+ */
+int pack_store_file(files_list_entry_t *source_entry, const char *relative_path) {
+    if (!pack_accepts(source_entry) || prepare_writing() == -1 || open_pack() == -1) {
+        return -1;
+    }
+    if (pack_buffered + source_entry->size > PACK_BUFFER_SIZE && flush_pack() == -1) {
+        return -1;
+    }
+    if (pack_size + pack_buffered >= PACK_MAX_SIZE) {
+        // Pack plein : ses enregistrements sont écrits avant de passer au suivant
+        if (flush_index() == -1) {
+            return -1;
+        }
+        close(pack_fd);
+        pack_fd = -1;
+        pack_number++;
+        if (open_pack() == -1) {
+            return -1;
+        }
+    }
+
+    int source_fd = open(source_entry->path_and_name, O_RDONLY);
+    STATS_ADD(syscalls, 1);
+    if (source_fd == -1) {
+        perror("Erreur dans l'ouverture du fichier");
+        return -1;
+    }
+    uint8_t *data = pack_buffer + pack_buffered;
+    size_t read_size = 0;
+    ssize_t bytes_read = 0;
+    while (read_size < source_entry->size
+           && (bytes_read = read(source_fd, data + read_size, source_entry->size - read_size)) > 0) {
+        RATELIMIT(bytes_read);
+        STATS_ADD(syscalls, 1);
+        read_size += (size_t)bytes_read;
+    }
+    close(source_fd);
+    if (read_size != source_entry->size) {
+        // Fichier modifié pendant la lecture : la prochaine exécution le verra différent
+        printf("Erreur dans la lecture de %s\n", source_entry->path_and_name);
+        return -1;
+    }
+    MD5(data, read_size, source_entry->md5sum);
+    STATS_ADD(files_hashed, 1);
+
+    pack_record_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.type = PACK_STORED;
+    header.pack_number = pack_number;
+    header.mode = source_entry->mode;
+    header.offset = pack_size + pack_buffered;
+    header.size = source_entry->size;
+    header.mtime_ns = (int64_t)source_entry->mtime.tv_sec * 1000000000LL + source_entry->mtime.tv_nsec;
+    memcpy(header.md5sum, source_entry->md5sum, sizeof(header.md5sum));
+    bool was_packed = lookup(relative_path) != NULL;
+    pack_buffered += read_size;
+    if (append_record(relative_path, &header) == -1) {
+        return -1;
+    }
+    // Un fichier qui n'était pas empaqueté peut exister dans la destination : il ne sera supprimé qu'après
+    // l'écriture de l'enregistrement qui le remplace (@see flush_index)
+    if (!was_packed) {
+        if (pending_count == pending_capacity) {
+            size_t capacity = pending_capacity ? pending_capacity * 2 : 1024;
+            char **removals = realloc(pending_removals, capacity * sizeof(char *));
+            if (removals == NULL) {
+                printf("Erreur d'allocation mémoire\n");
+                return -1;
+            }
+            pending_removals = removals;
+            pending_capacity = capacity;
+        }
+        pending_removals[pending_count] = strdup(relative_path);
+        if (pending_removals[pending_count] == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        pending_count++;
+    }
+    return 0;
+}
+
+/*!
+ * @brief pack_forget removes a file from the index, once it is stored as a regular file again
+ * @param relative_path is the path of the file, relative to the destination
+ * @return 0 in case of success, -1 else
+ */
+int pack_forget(const char *relative_path) {
+    if (lookup(relative_path) == NULL) {
+        return 0;
+    }
+    if (prepare_writing() == -1) {
+        return -1;
+    }
+    pack_record_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.type = PACK_REMOVED;
+    return append_record(relative_path, &header);
+}
+
+/*!
+ * @brief pack_flush writes the pending data and index records (synced with a durability mode)
+ * It must be called before the manifest of the destination records the packed files.
+ * @return 0 in case of success, -1 if some records could not be written
+ */
+int pack_flush(void) {
+    if (index_fd == -1) {
+        return 0;
+    }
+    return flush_index();
+}
+
+/*!
+ * @brief pack_close writes the pending data and index records, and releases the index
+ * @return 0 in case of success, -1 if some records could not be written
+ */
+int pack_close(void) {
+    int result = pack_flush();
+    if (index_fd != -1) {
+        close(index_fd);
+        index_fd = -1;
+    }
+    if (pack_fd != -1) {
+        close(pack_fd);
+        pack_fd = -1;
+    }
+    // Enregistrements non écrits : les fichiers ordinaires qu'ils devaient remplacer sont conservés
+    for (size_t i=0; i<pending_count; ++i) {
+        free(pending_removals[i]);
+    }
+    free(pending_removals);
+    pending_removals = NULL;
+    pending_count = pending_capacity = 0;
+    free(index_buffer);
+    free(pack_buffer);
+    index_buffer = pack_buffer = NULL;
+    index_buffered = pack_buffered = 0;
+    index_length = 0;
+    pack_number = 0;
+    pack_size = 0;
+    for (size_t i=0; i<slots_capacity; ++i) {
+        free(slots[i].path);
+    }
+    free(slots);
+    slots = NULL;
+    slots_capacity = slots_used = 0;
+    pack_enabled = false;
+    return result;
+}
+
+/*!
+ * @brief is_pack_entry tests if an entry is the packs directory or one of its files (they are never synchronized)
+ * @param entry is the entry to test
+ * @param root is the root of the tree of the entry
+ * @return true if the entry belongs to the packs, false else
+ */
+bool is_pack_entry(files_list_entry_t *entry, char *root) {
+    size_t root_length = strlen(root);
+    size_t name_length = strlen(PACK_DIRECTORY_NAME);
+    const char *relative_path = entry->path_and_name + root_length + 1;
+    return strncmp(entry->path_and_name, root, root_length) == 0
+        && strncmp(relative_path, PACK_DIRECTORY_NAME, name_length) == 0
+        && (relative_path[name_length] == '\0' || relative_path[name_length] == '/');
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <files-list.h>
+
+#define PACK_DIRECTORY_NAME ".lp25-packs"
+#define PACK_INDEX_NAME "index"
+#define PACK_RECORD_MAGIC 0x4c503250U // "LP2P"
+// Largest file that can be packed: a packed file always fits in the write buffer of the packs
+#define PACK_MAX_FILE_SIZE (4 * 1024 * 1024)
+// Packed data and index records are written by blocks of this size
+#define PACK_BUFFER_SIZE PACK_MAX_FILE_SIZE
+// A pack is no longer appended to once it reaches this size, the next one is started
+#define PACK_MAX_SIZE (1024ULL * 1024 * 1024)
+
+typedef enum { PACK_STORED = 1, PACK_REMOVED = 2 } pack_record_type_t;
+
+typedef struct {
+    uint32_t magic;
+    uint8_t type;
+    uint8_t padding;
+    uint16_t path_length;
+    uint32_t pack_number;
+    uint32_t mode;
+    uint64_t offset;
+    uint64_t size;
+    int64_t mtime_ns;
+    uint8_t md5sum[16];
+} pack_record_header_t;
+
+extern bool pack_enabled;
+
+int pack_open(char *destination, uint64_t threshold, bool durable);
+bool pack_accepts(files_list_entry_t *source_entry);
+bool pack_holds(const char *relative_path, uint64_t size, int64_t mtime_ns);
+int pack_add_to_list(files_list_t *list, char *root);
+int pack_store_file(files_list_entry_t *source_entry, const char *relative_path);
+int pack_forget(const char *relative_path);
+int pack_flush(void);
+int pack_close(void);
+bool is_pack_entry(files_list_entry_t *entry, char *root);
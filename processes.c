@@ -8,6 +8,8 @@
 #include <sync.h>
 #include <string.h>
 #include <errno.h>
+#include <stats.h>
+#include <trace.h>
 
 // Ajout (Lorenzo) pour faire fonctionner make_process
 #include <sys/types.h>
@@ -72,8 +74,11 @@ int make_process(process_context_t *p_context, process_loop_t func, void *parame
     }
 
     if (pid == 0) {
-        // Processus Fils
+        // Processus Fils : il dispose de son propre emplacement de statistiques
+        stats_attach_worker(func == lister_process_loop ? "lister" : "analyzer");
+        trace_attach_process(func == lister_process_loop ? "lister" : "analyzer");
         func(parameters); // Execute la fonction dans le processus fils
+        trace_flush();
         exit(EXIT_SUCCESS);
     } else {
         // Processus Parent
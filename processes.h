@@ -7,7 +7,7 @@
 #include <stdbool.h>
 
 typedef struct {
-    uint8_t processes_count;
+    uint16_t processes_count;
     pid_t main_process_pid;
     pid_t source_lister_pid;
     pid_t destination_lister_pid;
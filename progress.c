@@ -0,0 +1,163 @@
+#include <progress.h>
+#include <stats.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define PROGRESS_INTERVAL_MS 1000
+
+typedef struct {
+    uint64_t entries_listed;
+    uint64_t bytes_hashed;
+    uint64_t files_copied;
+    uint64_t bytes_copied;
+    uint64_t errors;
+} progress_totals_t;
+
+static pid_t reporter_pid = -1;
+static volatile sig_atomic_t reporter_running = 1;
+
+/*!
+ * @brief progress_sum reads the counters of all processes
+ * Each slot has a single writer, reads are relaxed atomic loads so the hot path never takes a lock.
+ * @param block is the shared statistics block
+ * @param totals is the structure receiving the sums
+ */
+static void progress_sum(stats_block_t *block, progress_totals_t *totals) {
+    memset(totals, 0, sizeof(progress_totals_t));
+    uint32_t count = __atomic_load_n(&block->workers_count, __ATOMIC_RELAXED);
+    if (count > STATS_MAX_WORKERS) {
+        count = STATS_MAX_WORKERS;
+    }
+    for (uint32_t i=0; i<count; ++i) {
+        worker_stats_t *w = &block->workers[i];
+        totals->entries_listed += __atomic_load_n(&w->entries_listed, __ATOMIC_RELAXED);
+        totals->bytes_hashed += __atomic_load_n(&w->bytes_hashed, __ATOMIC_RELAXED);
+        totals->files_copied += __atomic_load_n(&w->files_copied, __ATOMIC_RELAXED);
+        totals->bytes_copied += __atomic_load_n(&w->bytes_copied, __ATOMIC_RELAXED);
+        totals->errors += __atomic_load_n(&w->errors, __ATOMIC_RELAXED);
+    }
+}
+
+/*!
+ * @brief progress_display writes one progress sample, either as a TTY line or as a JSON line
+ * @param block is the shared statistics block
+ * @param now is the current totals
+ * @param previous is the totals of the previous sample (for rates)
+ * @param elapsed_s is the time since the previous sample, in seconds
+ * @param json_fd is the fd for JSON lines, -1 for the TTY line on stderr
+ * @param last is true for the final sample
+ */
+static void progress_display(stats_block_t *block, progress_totals_t *now, progress_totals_t *previous, double elapsed_s, int json_fd, bool last) {
+    double hash_rate = elapsed_s > 0 ? (now->bytes_hashed - previous->bytes_hashed) / elapsed_s : 0;
+    double copy_rate = elapsed_s > 0 ? (now->bytes_copied - previous->bytes_copied) / elapsed_s : 0;
+    uint64_t planned_bytes = __atomic_load_n(&block->planned_bytes, __ATOMIC_RELAXED);
+    uint64_t planned_files = __atomic_load_n(&block->planned_files, __ATOMIC_RELAXED);
+
+    // ETA seulement lorsque le diff a fixé le volume à copier
+    long eta_s = -1;
+    if (planned_bytes > 0 && copy_rate > 0 && now->bytes_copied <= planned_bytes) {
+        eta_s = (long)((planned_bytes - now->bytes_copied) / copy_rate);
+    }
+
+    if (json_fd >= 0) {
+        dprintf(json_fd, "{\"elapsed_ns\": %lu, \"entries_scanned\": %lu, \"bytes_hashed\": %lu, \"files_copied\": %lu, "
+                         "\"bytes_copied\": %lu, \"planned_files\": %lu, \"planned_bytes\": %lu, \"hash_rate\": %.0f, "
+                         "\"copy_rate\": %.0f, \"eta_s\": %ld, \"errors\": %lu, \"done\": %s}\n",
+                (unsigned long)(stats_now() - block->start_ns), (unsigned long)now->entries_listed,
+                (unsigned long)now->bytes_hashed, (unsigned long)now->files_copied, (unsigned long)now->bytes_copied,
+                (unsigned long)planned_files, (unsigned long)planned_bytes, hash_rate, copy_rate, eta_s,
+                (unsigned long)now->errors, last ? "true" : "false");
+    } else {
+        fprintf(stderr, "\r%lu entries | hashed %.1f MiB (%.1f MiB/s) | copied %lu/%lu files, %.1f/%.1f MiB (%.1f MiB/s) | ETA ",
+                (unsigned long)now->entries_listed, now->bytes_hashed / 1048576.0, hash_rate / 1048576.0,
+                (unsigned long)now->files_copied, (unsigned long)planned_files, now->bytes_copied / 1048576.0,
+                planned_bytes / 1048576.0, copy_rate / 1048576.0);
+        if (eta_s >= 0) {
+            fprintf(stderr, "%ldh%02ldm%02lds   ", eta_s / 3600, (eta_s / 60) % 60, eta_s % 60);
+        } else {
+            fprintf(stderr, "--   ");
+        }
+        if (last) {
+            fprintf(stderr, "\n");
+        }
+    }
+}
+
+/*!
+ * @brief progress_handle_term stops the reporter loop
+ * @param signum is the received signal (unused)
+ */
+static void progress_handle_term(int signum) {
+    (void)signum;
+    reporter_running = 0;
+}
+
+/*!
+ * @brief progress_loop is the reporter process function: it samples the shared counters periodically
+ * @param block is the shared statistics block
+ * @param json_fd is the fd for JSON lines, -1 for the TTY line
+ */
+static void progress_loop(stats_block_t *block, int json_fd) {
+    signal(SIGTERM, progress_handle_term);
+
+    progress_totals_t previous, now;
+    progress_sum(block, &previous);
+    uint64_t previous_ns = stats_now();
+    struct timespec interval = {PROGRESS_INTERVAL_MS / 1000, (PROGRESS_INTERVAL_MS % 1000) * 1000000L};
+
+    while (reporter_running) {
+        nanosleep(&interval, NULL);
+        uint64_t now_ns = stats_now();
+        progress_sum(block, &now);
+        progress_display(block, &now, &previous, (now_ns - previous_ns) / 1e9, json_fd, !reporter_running);
+        previous = now;
+        previous_ns = now_ns;
+    }
+}
+
+/*!
+ * @brief progress_start forks the progress reporter when --progress or --progress-fd is used
+ * It must be called after stats_init (the counters block must exist).
+ * @param the_config is a pointer to the configuration
+ * @return 0 in case of success (or nothing to do), -1 else
+ */
+int progress_start(configuration_t *the_config) {
+    if (the_config == NULL || (!the_config->show_progress && the_config->progress_fd < 0)) {
+        return 0;
+    }
+
+    stats_block_t *block = stats_shared_block();
+    if (block == NULL) {
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    reporter_pid = fork();
+    if (reporter_pid < 0) {
+        perror("Erreur de création du processus de progression");
+        return -1;
+    }
+    if (reporter_pid == 0) {
+        progress_loop(block, the_config->progress_fd);
+        exit(EXIT_SUCCESS);
+    }
+    return 0;
+}
+
+/*!
+ * @brief progress_stop asks the reporter for a final sample and waits for it
+ */
+void progress_stop(void) {
+    if (reporter_pid <= 0) {
+        return;
+    }
+    kill(reporter_pid, SIGTERM);
+    waitpid(reporter_pid, NULL, 0);
+    reporter_pid = -1;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <configuration.h>
+
+int progress_start(configuration_t *the_config);
+void progress_stop(void);
@@ -0,0 +1,131 @@
+#include <ratelimit.h>
+#include <stats.h>
+#include <trace.h>
+#include <stdio.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// Valeurs de linux/ioprio.h, absent de certaines libc
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+
+typedef struct {
+    int lock;
+    uint64_t bytes_per_second;
+    uint64_t operations_per_second;
+    int64_t byte_tokens;
+    int64_t operation_tokens;
+    uint64_t last_refill_ns;
+} token_bucket_t;
+
+bool ratelimit_enabled = false;
+static token_bucket_t *bucket = NULL;
+
+/*!
+ * @brief ratelimit_init creates the token bucket shared by all the worker processes
+ * Must be called before any fork. The bucket holds at most one second of tokens, which bounds the bursts.
+ * @param bytes_per_second is the bandwidth limit for reads and writes (0 for no limit)
+ * @param operations_per_second is the I/O operations limit (0 for no limit)
+ * @param idle_priority is true to put the process and its future children in the idle I/O scheduling class
+ * @return 0 in case of success, -1 else
+ */
+int ratelimit_init(uint64_t bytes_per_second, uint64_t operations_per_second, bool idle_priority) {
+    if (idle_priority) {
+        // La priorité d'E/S est héritée par les processus créés ensuite
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == -1) {
+            perror("Erreur lors du passage en priorité d'E/S idle");
+        }
+    }
+    if (bytes_per_second == 0 && operations_per_second == 0) {
+        return 0;
+    }
+    bucket = mmap(NULL, sizeof(token_bucket_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (bucket == MAP_FAILED) {
+        perror("Erreur lors de la création du limiteur de débit");
+        bucket = NULL;
+        return -1;
+    }
+    bucket->lock = 0;
+    bucket->bytes_per_second = bytes_per_second;
+    bucket->operations_per_second = operations_per_second;
+    bucket->byte_tokens = (int64_t)bytes_per_second;
+    bucket->operation_tokens = (int64_t)operations_per_second;
+    bucket->last_refill_ns = stats_now();
+    ratelimit_enabled = true;
+    return 0;
+}
+
+/*!
+ * @brief refill adds the tokens earned since the last refill, capped to one second of tokens
+ * Must be called with the bucket locked.
+ * @param now is the current time in ns
+ */
+static void refill(uint64_t now) {
+    uint64_t elapsed = now - bucket->last_refill_ns;
+    bucket->last_refill_ns = now;
+    if (bucket->bytes_per_second > 0) {
+        bucket->byte_tokens += (int64_t)(elapsed * (double)bucket->bytes_per_second / 1e9);
+        if (bucket->byte_tokens > (int64_t)bucket->bytes_per_second) {
+            bucket->byte_tokens = (int64_t)bucket->bytes_per_second;
+        }
+    }
+    if (bucket->operations_per_second > 0) {
+        bucket->operation_tokens += (int64_t)(elapsed * (double)bucket->operations_per_second / 1e9);
+        if (bucket->operation_tokens > (int64_t)bucket->operations_per_second) {
+            bucket->operation_tokens = (int64_t)bucket->operations_per_second;
+        }
+    }
+}
+
+/*!
+ * @brief ratelimit_acquire takes the tokens for one I/O operation of a given size, waiting if needed
+ * Tokens are taken at once, possibly going into debt; the caller then sleeps until the debt is paid back,
+ * so concurrent workers queue up behind each other instead of spinning on the bucket.
+ * @param bytes is the number of bytes the operation reads or writes
+ */
+void ratelimit_acquire(uint64_t bytes) {
+    if (bucket == NULL) {
+        return;
+    }
+    while (__atomic_exchange_n(&bucket->lock, 1, __ATOMIC_ACQUIRE)) {
+        sched_yield();
+    }
+    refill(stats_now());
+    uint64_t wait_ns = 0;
+    if (bucket->bytes_per_second > 0) {
+        bucket->byte_tokens -= (int64_t)bytes;
+        if (bucket->byte_tokens < 0) {
+            wait_ns = (uint64_t)(-bucket->byte_tokens * 1e9 / bucket->bytes_per_second);
+        }
+    }
+    if (bucket->operations_per_second > 0) {
+        bucket->operation_tokens -= 1;
+        if (bucket->operation_tokens < 0) {
+            uint64_t operations_wait = (uint64_t)(-bucket->operation_tokens * 1e9 / bucket->operations_per_second);
+            wait_ns = operations_wait > wait_ns ? operations_wait : wait_ns;
+        }
+    }
+    __atomic_store_n(&bucket->lock, 0, __ATOMIC_RELEASE);
+
+    if (wait_ns > 0) {
+        TRACE_BEGIN("throttle", "ratelimit");
+        struct timespec delay = {.tv_sec = wait_ns / 1000000000ULL, .tv_nsec = wait_ns % 1000000000ULL};
+        nanosleep(&delay, NULL);
+        TRACE_END("throttle", "ratelimit");
+    }
+}
+
+/*!
+ * @brief ratelimit_release unmaps the shared bucket
+ */
+void ratelimit_release(void) {
+    if (bucket != NULL) {
+        munmap(bucket, sizeof(token_bucket_t));
+        bucket = NULL;
+    }
+    ratelimit_enabled = false;
+}
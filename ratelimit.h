@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Copies are cut into chunks of this size when a limit is set, so that workers share the bucket fairly
+#define RATELIMIT_CHUNK_SIZE (1024 * 1024)
+
+extern bool ratelimit_enabled;
+
+#define RATELIMIT(bytes) do { if (ratelimit_enabled) ratelimit_acquire(bytes); } while (0)
+
+int ratelimit_init(uint64_t bytes_per_second, uint64_t operations_per_second, bool idle_priority);
+void ratelimit_acquire(uint64_t bytes);
+void ratelimit_release(void);
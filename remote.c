@@ -0,0 +1,673 @@
+#include <remote.h>
+#include <defines.h>
+#include <utility.h>
+#include <stats.h>
+#include <trace.h>
+#include <ratelimit.h>
+#include <metadata.h>
+#include <file-properties.h>
+#include <manifest.h>
+#include <journal.h>
+#include <sync.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// Connexion courante (une seule à la fois, côté émetteur comme côté récepteur)
+static int connection_fd = -1;
+static uint8_t output[REMOTE_BUFFER_SIZE];
+static size_t output_used = 0;
+static uint8_t input[REMOTE_BUFFER_SIZE];
+static size_t input_start = 0;
+static size_t input_end = 0;
+static uint8_t payload[REMOTE_DATA_SIZE];
+
+/*!
+ * @brief remote_is_address tests if a destination is the address of a receiver rather than a directory
+ * @param text is the destination given on the command line
+ * @return true for tcp://host:port and unix://path, false else
+ */
+bool remote_is_address(const char *text) {
+    return strncmp(text, REMOTE_TCP_PREFIX, strlen(REMOTE_TCP_PREFIX)) == 0
+        || strncmp(text, REMOTE_UNIX_PREFIX, strlen(REMOTE_UNIX_PREFIX)) == 0;
+}
+
+/*!
+ * @brief open_socket opens a socket connected to an address, or listening on it
+ * @param address is tcp://host:port (host may be * to listen on all interfaces, or [ipv6]) or unix://path
+ * @param listening is true for a receiver, false for a sender
+ * @return the socket, -1 in case of error
+ */
+static int open_socket(const char *address, bool listening) {
+    if (strncmp(address, REMOTE_UNIX_PREFIX, strlen(REMOTE_UNIX_PREFIX)) == 0) {
+        struct sockaddr_un local;
+        memset(&local, 0, sizeof(local));
+        local.sun_family = AF_UNIX;
+        const char *path = address + strlen(REMOTE_UNIX_PREFIX);
+        if (strlen(path) >= sizeof(local.sun_path)) {
+            printf("Chemin de socket trop long : %s\n", path);
+            return -1;
+        }
+        strcpy(local.sun_path, path);
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            perror("Erreur lors de la création de la socket");
+            return -1;
+        }
+        if (listening) {
+            // Socket laissée par un récepteur précédent
+            unlink(path);
+        }
+        if ((listening ? bind(fd, (struct sockaddr *)&local, sizeof(local)) : connect(fd, (struct sockaddr *)&local, sizeof(local))) == -1
+            || (listening && listen(fd, 4) == -1)) {
+            perror(address);
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // tcp://hôte:port, l'hôte IPv6 étant entre crochets
+    char host[256];
+    const char *start = address + strlen(REMOTE_TCP_PREFIX);
+    const char *separator = strrchr(start, ':');
+    if (separator == NULL || (size_t)(separator - start) >= sizeof(host)) {
+        printf("Adresse invalide : %s (tcp://hôte:port attendu)\n", address);
+        return -1;
+    }
+    snprintf(host, sizeof(host), "%.*s", (int)(separator - start), start);
+    char *node = host;
+    if (host[0] == '[' && host[strlen(host) - 1] == ']') {
+        host[strlen(host) - 1] = '\0';
+        node = host + 1;
+    }
+    // Hôte vide : boucle locale seulement ; * : toutes les interfaces, sans authentification des émetteurs
+    bool all_interfaces = strcmp(node, "*") == 0;
+    if (all_interfaces) {
+        node = NULL;
+    } else if (node[0] == '\0') {
+        node = listening ? "127.0.0.1" : NULL;
+    }
+    if (listening && all_interfaces) {
+        printf("Attention : tout hôte joignant %s peut écrire dans la destination (aucune authentification)\n", address);
+    }
+
+    struct addrinfo hints, *addresses;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening && all_interfaces ? AI_PASSIVE : 0;
+    int result = getaddrinfo(node, separator + 1, &hints, &addresses);
+    if (result != 0) {
+        printf("Adresse invalide : %s (%s)\n", address, gai_strerror(result));
+        return -1;
+    }
+    int fd = -1;
+    for (struct addrinfo *candidate = addresses; candidate != NULL && fd == -1; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd == -1) {
+            continue;
+        }
+        int enabled = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &enabled, sizeof(enabled));
+        }
+        if ((listening ? bind(fd, candidate->ai_addr, candidate->ai_addrlen) : connect(fd, candidate->ai_addr, candidate->ai_addrlen)) == -1
+            || (listening && listen(fd, 4) == -1)) {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        // Les trames sont déjà regroupées : Nagle ne ferait que retarder le dernier envoi
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+    }
+    freeaddrinfo(addresses);
+    if (fd == -1) {
+        perror(address);
+    }
+    return fd;
+}
+
+/*!
+ * @brief flush_output sends the buffered frames
+ * @return 0 in case of success, -1 if the connection is broken
+ */
+static int flush_output(void) {
+    size_t sent = 0;
+    while (sent < output_used) {
+        ssize_t result = send(connection_fd, output + sent, output_used - sent, MSG_NOSIGNAL);
+        if (result == -1 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            perror("Erreur lors de l'envoi");
+            output_used = 0;
+            return -1;
+        }
+        sent += result;
+    }
+    STATS_ADD(syscalls, 1);
+    output_used = 0;
+    return 0;
+}
+
+/*!
+ * @brief send_frame appends a frame to the output buffer, which is sent only when full (or flushed)
+ * @param type is the type of the frame
+ * @param header_part is the first part of the payload (may be NULL)
+ * @param header_length is its length
+ * @param body_part is the second part of the payload (may be NULL)
+ * @param body_length is its length
+ * @return 0 in case of success, -1 if the connection is broken
+ */
+static int send_frame(remote_frame_type_t type, const void *header_part, size_t header_length, const void *body_part, size_t body_length) {
+    remote_frame_header_t frame = {type, (uint32_t)(header_length + body_length)};
+    if (sizeof(frame) + frame.length > sizeof(output) - output_used && flush_output() == -1) {
+        return -1;
+    }
+    memcpy(output + output_used, &frame, sizeof(frame));
+    output_used += sizeof(frame);
+    if (header_length > 0) {
+        memcpy(output + output_used, header_part, header_length);
+        output_used += header_length;
+    }
+    if (body_length > 0) {
+        memcpy(output + output_used, body_part, body_length);
+        output_used += body_length;
+    }
+    return 0;
+}
+
+/*!
+ * @brief receive_exact reads bytes from the connection, through the input buffer
+ * @param buffer receives the bytes
+ * @param length is the number of bytes to read
+ * @return 0 in case of success, -1 if the connection is closed or broken
+ */
+static int receive_exact(void *buffer, size_t length) {
+    uint8_t *target = buffer;
+    while (length > 0) {
+        if (input_start == input_end) {
+            ssize_t result = recv(connection_fd, input, sizeof(input), 0);
+            if (result == -1 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                if (result == -1) {
+                    perror("Erreur lors de la réception");
+                }
+                return -1;
+            }
+            STATS_ADD(syscalls, 1);
+            input_start = 0;
+            input_end = result;
+        }
+        size_t available = input_end - input_start < length ? input_end - input_start : length;
+        memcpy(target, input + input_start, available);
+        input_start += available;
+        target += available;
+        length -= available;
+    }
+    return 0;
+}
+
+/*!
+ * @brief receive_frame reads the next frame into the payload buffer
+ * @param frame receives the header of the frame
+ * @return 0 in case of success, -1 if the connection is broken or the frame is invalid
+ */
+static int receive_frame(remote_frame_header_t *frame) {
+    if (receive_exact(frame, sizeof(remote_frame_header_t)) == -1) {
+        return -1;
+    }
+    if (frame->length > sizeof(payload)) {
+        printf("Trame invalide (%u octets)\n", frame->length);
+        return -1;
+    }
+    return receive_exact(payload, frame->length);
+}
+
+/*!
+ * @brief close_connection closes the current connection and resets the buffers
+ */
+static void close_connection(void) {
+    if (connection_fd != -1) {
+        close(connection_fd);
+    }
+    connection_fd = -1;
+    output_used = 0;
+    input_start = input_end = 0;
+}
+
+/*!
+ * @brief entry_to_remote fills the description of an entry sent over the connection
+ */
+static void entry_to_remote(remote_entry_t *remote, files_list_entry_t *entry) {
+    memset(remote, 0, sizeof(remote_entry_t));
+    remote->size = entry->size;
+    remote->mtime_ns = (int64_t)entry->mtime.tv_sec * 1000000000LL + entry->mtime.tv_nsec;
+    remote->mode = entry->mode;
+    remote->entry_type = (uint8_t)entry->entry_type;
+    memcpy(remote->md5sum, entry->md5sum, sizeof(remote->md5sum));
+}
+
+/*!
+ * @brief entry_from_payload reads an entry frame (remote_entry_t then path) from the payload buffer
+ * @param remote receives the description of the entry
+ * @param path receives the relative path
+ * @param length is the length of the payload
+ * @return 0 in case of success, -1 if the frame is invalid
+ */
+static int entry_from_payload(remote_entry_t *remote, char *path, uint32_t length) {
+    if (length <= sizeof(remote_entry_t) || length - sizeof(remote_entry_t) >= PATH_SIZE) {
+        printf("Entrée invalide\n");
+        return -1;
+    }
+    memcpy(remote, payload, sizeof(remote_entry_t));
+    memcpy(path, payload + sizeof(remote_entry_t), length - sizeof(remote_entry_t));
+    path[length - sizeof(remote_entry_t)] = '\0';
+    return 0;
+}
+
+/*!
+ * @brief remote_connect connects to a receiver and asks it to list its destination
+ * The receiver lists (and hashes if needed) its tree while the sender lists the source.
+ * @param address is the address of the receiver
+ * @param uses_md5 is true if the MD5 sums of the destination files are needed
+ * @return 0 in case of success, -1 else
+ */
+int remote_connect(const char *address, bool uses_md5) {
+    connection_fd = open_socket(address, false);
+    if (connection_fd == -1) {
+        return -1;
+    }
+    remote_hello_t hello;
+    memset(&hello, 0, sizeof(hello));
+    memcpy(hello.magic, REMOTE_MAGIC, sizeof(REMOTE_MAGIC));
+    hello.version = REMOTE_VERSION;
+    hello.flags = uses_md5 ? REMOTE_HELLO_MD5 : 0;
+    if (send_frame(REMOTE_HELLO, &hello, sizeof(hello), NULL, 0) == -1 || flush_output() == -1) {
+        close_connection();
+        return -1;
+    }
+    return 0;
+}
+
+/*!
+ * @brief remote_list_destination receives the entries of the destination from the receiver
+ * @param list is the list to fill
+ * @param destination is the address of the receiver, prepended to the relative paths like a local root
+ * @return 0 in case of success, -1 else (the connection is closed)
+ */
+int remote_list_destination(files_list_t *list, char *destination) {
+    uint64_t list_start = stats_begin();
+    TRACE_BEGIN("remote_list", "list");
+    remote_frame_header_t frame;
+    int result = -1;
+    while (receive_frame(&frame) == 0) {
+        if (frame.type == REMOTE_LIST_END) {
+            result = 0;
+            break;
+        }
+        remote_entry_t remote;
+        char relative_path[PATH_SIZE];
+        if (frame.type != REMOTE_ENTRY || entry_from_payload(&remote, relative_path, frame.length) == -1) {
+            break;
+        }
+        files_list_entry_t *entry = malloc(sizeof(files_list_entry_t));
+        if (entry == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            break;
+        }
+        memset(entry, 0, sizeof(files_list_entry_t));
+        if (snprintf(entry->path_and_name, sizeof(entry->path_and_name), "%s/%s", destination, relative_path) >= (int)sizeof(entry->path_and_name)) {
+            // Entrée ignorée plutôt que tronquée : elle serait comparée à un autre fichier de la source
+            printf("Chemin trop long : %s\n", relative_path);
+            STATS_ADD(errors, 1);
+            free(entry);
+            continue;
+        }
+        entry->size = remote.size;
+        entry->mtime.tv_sec = remote.mtime_ns / 1000000000LL;
+        entry->mtime.tv_nsec = remote.mtime_ns % 1000000000LL;
+        entry->mode = remote.mode;
+        entry->entry_type = remote.entry_type == DOSSIER ? DOSSIER : FICHIER;
+        memcpy(entry->md5sum, remote.md5sum, sizeof(entry->md5sum));
+        add_entry_to_tail(list, entry);
+        STATS_ADD(entries_listed, 1);
+    }
+    TRACE_END("remote_list", "list");
+    stats_end(PHASE_LIST, list_start);
+    if (result == -1) {
+        printf("Liste de la destination distante incomplète\n");
+        close_connection();
+    }
+    return result;
+}
+
+/*!
+ * @brief remote_send_entry sends an entry of the source to the receiver, without waiting for it
+ * A directory is a single frame; a file is sent with its content, read in REMOTE_DATA_SIZE frames.
+ * @param entry is the source entry
+ * @param relative_path is its path relative to the source root
+ * @return 0 in case of success (the file may still fail on the receiver, @see remote_finish), -1 else
+ */
+int remote_send_entry(files_list_entry_t *entry, const char *relative_path) {
+    remote_entry_t remote;
+    entry_to_remote(&remote, entry);
+    if (entry->entry_type == DOSSIER) {
+        return send_frame(REMOTE_MKDIR, &remote, sizeof(remote), relative_path, strlen(relative_path));
+    }
+
+    uint64_t copy_start = stats_begin();
+    TRACE_BEGIN("remote_copy", "sync");
+    int source_fd = open(entry->path_and_name, O_RDONLY);
+    STATS_ADD(syscalls, 1);
+    if (source_fd == -1) {
+        perror(entry->path_and_name);
+        STATS_ADD(errors, 1);
+        TRACE_END("remote_copy", "sync");
+        stats_end(PHASE_COPY, copy_start);
+        return 0;
+    }
+    int result = send_frame(REMOTE_FILE, &remote, sizeof(remote), relative_path, strlen(relative_path));
+    uint64_t sent = 0;
+    uint32_t status = 0;
+    while (result == 0 && sent < entry->size) {
+        uint64_t wanted = entry->size - sent < REMOTE_DATA_SIZE ? entry->size - sent : REMOTE_DATA_SIZE;
+        RATELIMIT(wanted);
+        ssize_t count = read(source_fd, payload, wanted);
+        STATS_ADD(syscalls, 1);
+        if (count <= 0) {
+            // Fichier raccourci ou illisible : le récepteur abandonne sa copie
+            perror(entry->path_and_name);
+            STATS_ADD(errors, 1);
+            status = 1;
+            break;
+        }
+        result = send_frame(REMOTE_DATA, payload, count, NULL, 0);
+        sent += count;
+    }
+    close(source_fd);
+    if (result == 0) {
+        result = send_frame(REMOTE_FILE_END, &status, sizeof(status), NULL, 0);
+    }
+    if (result == 0 && status == 0) {
+        STATS_ADD(files_copied, 1);
+        STATS_ADD(bytes_copied, sent);
+    }
+    TRACE_END("remote_copy", "sync");
+    stats_end(PHASE_COPY, copy_start);
+    return result;
+}
+
+/*!
+ * @brief remote_finish ends the synchronization: the receiver applies the directories metadata and answers
+ * This is the only round trip after the listing.
+ * @param result receives the counts of the receiver
+ * @return 0 in case of success, -1 else
+ */
+int remote_finish(remote_result_t *result) {
+    remote_frame_header_t frame;
+    int status = -1;
+    if (connection_fd != -1 && send_frame(REMOTE_DONE, NULL, 0, NULL, 0) == 0 && flush_output() == 0
+        && receive_frame(&frame) == 0 && frame.type == REMOTE_RESULT && frame.length == sizeof(remote_result_t)) {
+        memcpy(result, payload, sizeof(remote_result_t));
+        status = 0;
+    } else {
+        printf("La destination distante n'a pas confirmé la synchronisation\n");
+    }
+    close_connection();
+    return status;
+}
+
+/*!
+ * @brief is_safe_path tests that a path received from a sender stays inside the destination
+ * @param path is the relative path
+ * @return true if it is relative and has no .. component, false else
+ */
+static bool is_safe_path(const char *path) {
+    if (path[0] == '/' || path[0] == '\0') {
+        return false;
+    }
+    for (const char *component = path; component != NULL; component = strchr(component, '/')) {
+        component += *component == '/';
+        if (strncmp(component, "..", 2) == 0 && (component[2] == '/' || component[2] == '\0')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * @brief send_destination_list lists the destination tree and sends it to the sender
+ * @param root is the destination root
+ * @param uses_md5 is true if the MD5 sums of the files must be computed
+ * @param workers_count is the number of hashing processes
+ * @return 0 in case of success, -1 else
+ */
+static int send_destination_list(char *root, bool uses_md5, int workers_count) {
+    files_list_t list = {NULL, NULL};
+    make_files_list(&list, root);
+    size_t root_length = strlen(root) + 1;
+
+    if (uses_md5) {
+        size_t count = 0;
+        for (files_list_entry_t *cursor = list.head; cursor != NULL; cursor = cursor->next) {
+            count += cursor->entry_type == FICHIER;
+        }
+        files_list_entry_t **files = malloc((count ? count : 1) * sizeof(files_list_entry_t *));
+        if (files == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            clear_files_list(&list);
+            return -1;
+        }
+        size_t i = 0;
+        for (files_list_entry_t *cursor = list.head; cursor != NULL; cursor = cursor->next) {
+            if (cursor->entry_type == FICHIER) {
+                files[i++] = cursor;
+            }
+        }
+        compute_files_md5_parallel(files, count, workers_count, HASH_FULL);
+        free(files);
+    }
+
+    int result = 0;
+    for (files_list_entry_t *cursor = list.head; cursor != NULL && result == 0; cursor = cursor->next) {
+        if (strlen(cursor->path_and_name) <= root_length || is_manifest_entry(cursor, root) || is_journal_entry(cursor, root)) {
+            continue;
+        }
+        remote_entry_t remote;
+        entry_to_remote(&remote, cursor);
+        const char *relative_path = cursor->path_and_name + root_length;
+        result = send_frame(REMOTE_ENTRY, &remote, sizeof(remote), relative_path, strlen(relative_path));
+    }
+    clear_files_list(&list);
+    if (result == 0) {
+        result = send_frame(REMOTE_LIST_END, NULL, 0, NULL, 0);
+    }
+    return result == 0 ? flush_output() : -1;
+}
+
+/*!
+ * @brief serve_connection handles a sender: sends the destination list, then writes the entries it receives
+ * Errors on an entry are counted and reported at the end, the transfer goes on.
+ * @param root is the destination root
+ * @param the_config is a pointer to the configuration of the receiver
+ */
+static void serve_connection(char *root, configuration_t *the_config) {
+    remote_frame_header_t frame;
+    remote_hello_t hello;
+    if (receive_frame(&frame) == -1 || frame.type != REMOTE_HELLO || frame.length != sizeof(hello)) {
+        printf("Connexion refusée : protocole inconnu\n");
+        return;
+    }
+    memcpy(&hello, payload, sizeof(hello));
+    if (memcmp(hello.magic, REMOTE_MAGIC, sizeof(REMOTE_MAGIC)) != 0 || hello.version != REMOTE_VERSION) {
+        printf("Connexion refusée : version du protocole différente\n");
+        return;
+    }
+    if (send_destination_list(root, hello.flags & REMOTE_HELLO_MD5, the_config->processes_count) == -1) {
+        return;
+    }
+
+    remote_result_t result = {0, 0};
+    int file_fd = -1;
+    // Un fichier est écrit à côté de sa version précédente, qui n'est remplacée qu'une fois le transfert réussi
+    char file_path[PATH_SIZE], temporary_path[PATH_SIZE];
+    remote_entry_t file;
+    memset(&file, 0, sizeof(file));
+    uint64_t written = 0;
+    bool done = false;
+    while (!done && receive_frame(&frame) == 0) {
+        remote_entry_t remote;
+        char relative_path[PATH_SIZE], path[PATH_SIZE];
+        switch (frame.type) {
+            case REMOTE_MKDIR:
+            case REMOTE_FILE:
+                if (entry_from_payload(&remote, relative_path, frame.length) == -1 || !is_safe_path(relative_path)
+                    || concat_path(path, root, relative_path) == NULL) {
+                    printf("Chemin refusé\n");
+                    result.errors++;
+                    break;
+                }
+                if (frame.type == REMOTE_MKDIR) {
+                    struct timespec mtime = {remote.mtime_ns / 1000000000LL, remote.mtime_ns % 1000000000LL};
+                    STATS_ADD(syscalls, 1);
+                    if (mkdir(path, (remote.mode & 07777) | S_IRWXU) != 0 && errno != EEXIST) {
+                        perror(path);
+                        result.errors++;
+                    } else {
+                        metadata_defer_directory(path, remote.mode, &mtime);
+                        result.entries_written++;
+                    }
+                    break;
+                }
+                // Fichier précédent non terminé (trame perdue) : il est abandonné
+                if (file_fd != -1) {
+                    close(file_fd);
+                    unlink(temporary_path);
+                    file_fd = -1;
+                    result.errors++;
+                }
+                strcpy(file_path, path);
+                // Nom temporaire tronqué : il pourrait désigner un autre fichier, remplacé ensuite par le renommage
+                if (snprintf(temporary_path, sizeof(temporary_path), "%s.%d.tmp", path, (int)getpid()) >= PATH_SIZE) {
+                    printf("Chemin refusé\n");
+                    result.errors++;
+                    break;
+                }
+                STATS_ADD(syscalls, 1);
+                file_fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+                if (file_fd == -1) {
+                    perror(temporary_path);
+                    result.errors++;
+                }
+                file = remote;
+                written = 0;
+                break;
+            case REMOTE_DATA:
+                // Données d'un fichier qui n'a pas pu être ouvert : ignorées
+                if (file_fd != -1) {
+                    RATELIMIT(frame.length);
+                    STATS_ADD(syscalls, 1);
+                    if (write(file_fd, payload, frame.length) != (ssize_t)frame.length) {
+                        perror(temporary_path);
+                        close(file_fd);
+                        unlink(temporary_path);
+                        file_fd = -1;
+                        result.errors++;
+                    }
+                    written += frame.length;
+                }
+                break;
+            case REMOTE_FILE_END:
+                if (file_fd != -1) {
+                    uint32_t status;
+                    memcpy(&status, payload, frame.length == sizeof(status) ? sizeof(status) : 0);
+                    struct timespec mtime = {file.mtime_ns / 1000000000LL, file.mtime_ns % 1000000000LL};
+                    bool failed = frame.length != sizeof(status) || status != 0 || written != file.size
+                        || metadata_apply_fd(file_fd, file.mode, &mtime) == -1;
+                    close(file_fd);
+                    STATS_ADD(syscalls, 1);
+                    if (failed || rename(temporary_path, file_path) == -1) {
+                        if (!failed) {
+                            perror(file_path);
+                        }
+                        unlink(temporary_path);
+                        result.errors++;
+                    } else {
+                        STATS_ADD(files_copied, 1);
+                        STATS_ADD(bytes_copied, written);
+                        result.entries_written++;
+                    }
+                    file_fd = -1;
+                }
+                break;
+            case REMOTE_DONE:
+                done = true;
+                break;
+            default:
+                printf("Trame inattendue (%u)\n", frame.type);
+                result.errors++;
+                break;
+        }
+    }
+    if (file_fd != -1) {
+        close(file_fd);
+        unlink(temporary_path);
+        result.errors++;
+    }
+    metadata_apply_directories();
+    if (done) {
+        if (send_frame(REMOTE_RESULT, &result, sizeof(result), NULL, 0) == 0) {
+            flush_output();
+        }
+    } else {
+        printf("Connexion interrompue par l'émetteur\n");
+    }
+    printf("Synchronisation reçue : %llu entrées écrites, %llu erreurs\n",
+           (unsigned long long)result.entries_written, (unsigned long long)result.errors);
+}
+
+/*!
+ * @brief remote_serve runs the receiver (--serve): it owns the destination tree and handles senders one at a time
+ * The receiver lists, hashes and writes the destination locally, so that the sender never does a round
+ * trip per file: the protocol only waits for the destination list and for the final result.
+ * @param address is the address to listen on (tcp://host:port or unix://path)
+ * @param root is the destination root
+ * @param the_config is a pointer to the configuration
+ * @return -1 if the address cannot be listened on (else it never returns)
+ */
+int remote_serve(char *address, char *root, configuration_t *the_config) {
+    int listening_fd = open_socket(address, true);
+    if (listening_fd == -1) {
+        return -1;
+    }
+    printf("En attente de connexions sur %s (destination %s)\n", address, root);
+    fflush(stdout);
+    while (true) {
+        connection_fd = accept(listening_fd, NULL, NULL);
+        if (connection_fd == -1) {
+            if (errno != EINTR) {
+                perror("Erreur lors de l'acceptation d'une connexion");
+            }
+            continue;
+        }
+        int enabled = 1;
+        setsockopt(connection_fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+        serve_connection(root, the_config);
+        close_connection();
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <files-list.h>
+#include <configuration.h>
+
+// A destination given as tcp://host:port or unix:///path/to/socket is owned by a receiver (--serve)
+#define REMOTE_TCP_PREFIX "tcp://"
+#define REMOTE_UNIX_PREFIX "unix://"
+#define REMOTE_MAGIC "LP25NET"
+#define REMOTE_VERSION 1
+// Frames are gathered in a buffer of this size and sent together, without waiting for any answer
+#define REMOTE_BUFFER_SIZE (256 * 1024)
+// Files contents are sent in frames of at most this size (it is also the largest payload of a frame)
+#define REMOTE_DATA_SIZE (128 * 1024)
+
+typedef enum {
+    REMOTE_HELLO = 1, // Sender: remote_hello_t
+    REMOTE_ENTRY,     // Receiver: remote_entry_t and path, an entry of the destination
+    REMOTE_LIST_END,  // Receiver: end of the destination entries
+    REMOTE_MKDIR,     // Sender: remote_entry_t and path, a directory to create
+    REMOTE_FILE,      // Sender: remote_entry_t and path, a file whose content follows
+    REMOTE_DATA,      // Sender: next bytes of the current file
+    REMOTE_FILE_END,  // Sender: uint32_t, 0 if the whole file was read from the source
+    REMOTE_DONE,      // Sender: no more entries
+    REMOTE_RESULT     // Receiver: remote_result_t
+} remote_frame_type_t;
+
+typedef struct {
+    uint32_t type;
+    uint32_t length; // Length of the payload that follows
+} remote_frame_header_t;
+
+#define REMOTE_HELLO_MD5 1 // The receiver computes the MD5 sums of its files
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+} remote_hello_t;
+
+typedef struct {
+    uint64_t size;
+    int64_t mtime_ns;
+    uint32_t mode;
+    uint8_t entry_type;
+    uint8_t padding[3];
+    uint8_t md5sum[16];
+} remote_entry_t;
+
+typedef struct {
+    uint64_t entries_written;
+    uint64_t errors;
+} remote_result_t;
+
+bool remote_is_address(const char *text);
+int remote_connect(const char *address, bool uses_md5);
+int remote_list_destination(files_list_t *list, char *destination);
+int remote_send_entry(files_list_entry_t *entry, const char *relative_path);
+int remote_finish(remote_result_t *result);
+int remote_serve(char *address, char *root, configuration_t *the_config);
@@ -0,0 +1,83 @@
+#include <snapshot.h>
+#include <defines.h>
+#include <utility.h>
+#include <stats.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*!
+ * @brief snapshot_prepare creates the directory of a new snapshot and finds the previous one
+ * The previous snapshot is the target of the "latest" link, which is only updated once a snapshot is
+ * complete: an interrupted snapshot is never used as a base.
+ * @param destination is the destination root, holding the snapshots
+ * @param previous receives the path of the previous snapshot (PATH_SIZE bytes), empty if none
+ * @param current receives the path of the new snapshot (PATH_SIZE bytes)
+ * @return 0 in case of success, -1 else
+ */
+int snapshot_prepare(char *destination, char *previous, char *current) {
+    char latest_path[PATH_SIZE], latest_name[PATH_SIZE];
+    previous[0] = '\0';
+    if (concat_path(latest_path, destination, SNAPSHOT_LATEST_LINK) == NULL) {
+        return -1;
+    }
+    ssize_t length = readlink(latest_path, latest_name, sizeof(latest_name) - 1);
+    STATS_ADD(syscalls, 1);
+    if (length > 0) {
+        latest_name[length] = '\0';
+        if (concat_path(previous, destination, latest_name) == NULL) {
+            previous[0] = '\0';
+        }
+    }
+
+    // Nom daté, suffixé si une autre sauvegarde a eu lieu dans la même seconde
+    char name[64];
+    time_t now = time(NULL);
+    struct tm local;
+    localtime_r(&now, &local);
+    size_t name_length = strftime(name, sizeof(name), SNAPSHOT_NAME_FORMAT, &local);
+    for (int suffix = 1; ; ++suffix) {
+        if (concat_path(current, destination, name) == NULL) {
+            return -1;
+        }
+        STATS_ADD(syscalls, 1);
+        if (mkdir(current, 0755) == 0) {
+            break;
+        }
+        if (errno != EEXIST || suffix == 100) {
+            perror("Erreur lors de la création de l'instantané");
+            return -1;
+        }
+        snprintf(name + name_length, sizeof(name) - name_length, "-%d", suffix);
+    }
+    printf("Instantané %s%s%s\n", current, previous[0] ? ", à partir de " : "", previous);
+    return 0;
+}
+
+/*!
+ * @brief snapshot_publish points the "latest" link to a complete snapshot, atomically (new link then rename)
+ * @param destination is the destination root
+ * @param current is the path of the snapshot
+ * @return 0 in case of success, -1 else
+ */
+int snapshot_publish(char *destination, const char *current) {
+    char latest_path[PATH_SIZE], temporary_path[PATH_SIZE];
+    if (concat_path(latest_path, destination, SNAPSHOT_LATEST_LINK) == NULL
+        || concat_path(temporary_path, destination, SNAPSHOT_LATEST_LINK ".tmp") == NULL) {
+        return -1;
+    }
+    // Lien relatif : la destination reste utilisable si elle est déplacée ou montée ailleurs
+    const char *name = strrchr(current, '/');
+    name = name != NULL ? name + 1 : current;
+    unlink(temporary_path);
+    STATS_ADD(syscalls, 3);
+    if (symlink(name, temporary_path) == -1 || rename(temporary_path, latest_path) == -1) {
+        perror("Erreur lors de la publication de l'instantané");
+        unlink(temporary_path);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Symbolic link to the last complete snapshot, inside the destination
+#define SNAPSHOT_LATEST_LINK "latest"
+// strftime format of the snapshots directories names
+#define SNAPSHOT_NAME_FORMAT "%Y-%m-%d_%H%M%S"
+
+int snapshot_prepare(char *destination, char *previous, char *current);
+int snapshot_publish(char *destination, const char *current);
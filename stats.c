@@ -0,0 +1,234 @@
+#include <stats.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Bloc partagé par tous les processus (alloué avant les fork), NULL si les statistiques sont désactivées
+static stats_block_t *stats_block = NULL;
+// Emplacement utilisé lorsque les statistiques sont désactivées : les compteurs restent valides mais ne sont jamais lus
+static worker_stats_t stats_sink;
+worker_stats_t *my_stats = &stats_sink;
+
+// Profondeur d'imbrication des phases du processus (stat et hash sont mesurés à l'intérieur de list)
+static int phase_depth = 0;
+
+static const char *phase_names[PHASE_COUNT] = {"list", "stat", "hash", "diff", "copy"};
+
+/*!
+ * @brief stats_init allocates the statistics block shared by the main process and its children
+ * It must be called before any fork so that listers and analyzers write into the same block.
+ * Each process owns a slot (aligned on a cache line), so counters are never contended.
+ * @param enabled is true when the --stats or a progress option was given
+ * @return 0 in case of success, -1 else
+ */
+int stats_init(bool enabled) {
+    if (!enabled) {
+        return 0;
+    }
+
+    stats_block = mmap(NULL, sizeof(stats_block_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (stats_block == MAP_FAILED) {
+        perror("Erreur lors de l'allocation des statistiques");
+        stats_block = NULL;
+        return -1;
+    }
+    memset(stats_block, 0, sizeof(stats_block_t));
+    stats_block->start_ns = stats_now();
+    stats_attach_worker("main");
+    return 0;
+}
+
+/*!
+ * @brief stats_attach_worker reserves a slot of the shared block for the calling process
+ * Called by the main process at init and by each child right after fork.
+ * @param role is a short name for the process (main, lister, analyzer...)
+ */
+void stats_attach_worker(const char *role) {
+    if (stats_block == NULL) {
+        return;
+    }
+
+    uint32_t slot = __atomic_fetch_add(&stats_block->slots_next, 1, __ATOMIC_RELAXED);
+    if (slot >= STATS_MAX_WORKERS) {
+        // Plus de place : le processus écrit dans l'emplacement poubelle
+        fprintf(stderr, "Statistiques : plus d'emplacement libre, le processus %s n'est pas compté\n", role);
+        my_stats = &stats_sink;
+        return;
+    }
+    // Nombre d'emplacements rapportés : le plus grand jamais utilisé
+    uint32_t used = __atomic_load_n(&stats_block->workers_count, __ATOMIC_RELAXED);
+    while (used < slot + 1 && !__atomic_compare_exchange_n(&stats_block->workers_count, &used, slot + 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    my_stats = &stats_block->workers[slot];
+    my_stats->pid = getpid();
+    // Les phases en cours du parent ne concernent pas le nouveau processus
+    phase_depth = 0;
+    strncpy(my_stats->role, role, sizeof(my_stats->role) - 1);
+}
+
+/*!
+ * @brief stats_slots_mark returns the next slot to give, before starting a pool of processes
+ * @return the mark to give to stats_slots_release once the pool is finished
+ */
+uint32_t stats_slots_mark(void) {
+    return stats_block == NULL ? 0 : __atomic_load_n(&stats_block->slots_next, __ATOMIC_RELAXED);
+}
+
+/*!
+ * @brief stats_slots_release gives the slots of a finished pool again to the next processes
+ * Their counters are kept: the next processes of the same rank add to them.
+ * @param mark is the value returned by stats_slots_mark before the pool was started
+ */
+void stats_slots_release(uint32_t mark) {
+    if (stats_block == NULL) {
+        return;
+    }
+    __atomic_store_n(&stats_block->slots_next, mark, __ATOMIC_RELAXED);
+}
+
+/*!
+ * @brief stats_now returns the value of the monotonic clock
+ * @return the current time in nanoseconds
+ */
+uint64_t stats_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/*!
+ * @brief stats_begin starts timing a phase
+ * Phases may be nested (a stat inside a listing): busy time only accounts for the outermost phase.
+ * @return the start timestamp to give to stats_end, 0 when statistics are disabled (no clock read)
+ */
+uint64_t stats_begin(void) {
+    if (stats_block == NULL) {
+        return 0;
+    }
+    phase_depth++;
+    return stats_now();
+}
+
+/*!
+ * @brief stats_end adds the time elapsed since start to a phase of the calling process
+ * @param phase is the phase to account the time to
+ * @param start is the value returned by stats_begin
+ */
+void stats_end(stats_phase_t phase, uint64_t start) {
+    if (stats_block == NULL) {
+        return;
+    }
+    uint64_t elapsed = stats_now() - start;
+    my_stats->phase_ns[phase] += elapsed;
+    if (--phase_depth == 0) {
+        my_stats->busy_ns += elapsed;
+    }
+}
+
+/*!
+ * @brief stats_plan records the amount of copy work found by the diff, so that progress can estimate an ETA
+ * @param files is the number of entries to copy
+ * @param bytes is the number of bytes to copy
+ */
+void stats_plan(uint64_t files, uint64_t bytes) {
+    if (stats_block == NULL) {
+        return;
+    }
+    __atomic_store_n(&stats_block->planned_files, files, __ATOMIC_RELAXED);
+    __atomic_store_n(&stats_block->planned_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/*!
+ * @brief stats_shared_block gives access to the shared block (for the progress reporter)
+ * @return a pointer to the block, NULL when it was not allocated
+ */
+stats_block_t *stats_shared_block(void) {
+    return stats_block;
+}
+
+/*!
+ * @brief stats_report writes the JSON report of all processes
+ * @param report_path is the path of the report file, an empty string to write on stdout, NULL for no report
+ * @return 0 in case of success (or when statistics are disabled), -1 else
+ */
+int stats_report(const char *report_path) {
+    if (stats_block == NULL || report_path == NULL) {
+        return 0;
+    }
+
+    FILE *report = stdout;
+    if (report_path[0] != '\0') {
+        report = fopen(report_path, "w");
+        if (report == NULL) {
+            perror("Erreur lors de l'ouverture du rapport de statistiques");
+            return -1;
+        }
+    }
+
+    uint32_t count = stats_block->workers_count;
+    if (count > STATS_MAX_WORKERS) {
+        count = STATS_MAX_WORKERS;
+    }
+
+    // Cumul de tous les processus
+    worker_stats_t total;
+    memset(&total, 0, sizeof(total));
+    for (uint32_t i=0; i<count; ++i) {
+        worker_stats_t *w = &stats_block->workers[i];
+        for (int p=0; p<PHASE_COUNT; ++p) {
+            total.phase_ns[p] += w->phase_ns[p];
+        }
+        total.entries_listed += w->entries_listed;
+        total.files_stated += w->files_stated;
+        total.files_hashed += w->files_hashed;
+        total.bytes_hashed += w->bytes_hashed;
+        total.files_copied += w->files_copied;
+        total.bytes_copied += w->bytes_copied;
+        total.files_linked += w->files_linked;
+        total.files_moved += w->files_moved;
+        total.chunks_stored += w->chunks_stored;
+        total.chunks_reused += w->chunks_reused;
+        total.syscalls += w->syscalls;
+        total.errors += w->errors;
+    }
+
+    fprintf(report, "{\n  \"wall_ns\": %lu,\n", (unsigned long)(stats_now() - stats_block->start_ns));
+    fprintf(report, "  \"phases_ns\": {");
+    for (int p=0; p<PHASE_COUNT; ++p) {
+        fprintf(report, "%s\"%s\": %lu", p ? ", " : "", phase_names[p], (unsigned long)total.phase_ns[p]);
+    }
+    fprintf(report, "},\n");
+    fprintf(report, "  \"counters\": {\"entries_listed\": %lu, \"files_stated\": %lu, \"files_hashed\": %lu, "
+                    "\"bytes_hashed\": %lu, \"files_copied\": %lu, \"bytes_copied\": %lu, \"files_linked\": %lu, \"files_moved\": %lu, \"chunks_stored\": %lu, \"chunks_reused\": %lu, \"syscalls\": %lu, \"errors\": %lu},\n",
+            (unsigned long)total.entries_listed, (unsigned long)total.files_stated, (unsigned long)total.files_hashed,
+            (unsigned long)total.bytes_hashed, (unsigned long)total.files_copied, (unsigned long)total.bytes_copied,
+            (unsigned long)total.files_linked, (unsigned long)total.files_moved, (unsigned long)total.chunks_stored, (unsigned long)total.chunks_reused, (unsigned long)total.syscalls, (unsigned long)total.errors);
+    fprintf(report, "  \"workers\": [\n");
+    for (uint32_t i=0; i<count; ++i) {
+        worker_stats_t *w = &stats_block->workers[i];
+        fprintf(report, "    {\"slot\": %u, \"role\": \"%s\", \"pid\": %d, \"busy_ns\": %lu, \"entries_listed\": %lu, "
+                        "\"bytes_hashed\": %lu, \"bytes_copied\": %lu, \"syscalls\": %lu, \"errors\": %lu}%s\n",
+                i, w->role, (int)w->pid, (unsigned long)w->busy_ns, (unsigned long)w->entries_listed,
+                (unsigned long)w->bytes_hashed, (unsigned long)w->bytes_copied, (unsigned long)w->syscalls,
+                (unsigned long)w->errors, (i + 1 < count) ? "," : "");
+    }
+    fprintf(report, "  ]\n}\n");
+
+    if (report != stdout) {
+        fclose(report);
+    }
+    return 0;
+}
+
+/*!
+ * @brief stats_release frees the shared statistics block
+ */
+void stats_release(void) {
+    if (stats_block != NULL) {
+        munmap(stats_block, sizeof(stats_block_t));
+        stats_block = NULL;
+        my_stats = &stats_sink;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+#include <configuration.h>
+
+// A slot per process: the main process, its listers and analyzers, and up to -n hashers at a time
+#define STATS_MAX_WORKERS (MAX_PROCESSES_COUNT + 16)
+
+typedef enum { PHASE_LIST, PHASE_STAT, PHASE_HASH, PHASE_DIFF, PHASE_COPY, PHASE_COUNT } stats_phase_t;
+
+typedef struct {
+    pid_t pid;
+    char role[16];
+    uint64_t phase_ns[PHASE_COUNT];
+    uint64_t busy_ns;
+    uint64_t entries_listed;
+    uint64_t files_stated;
+    uint64_t files_hashed;
+    uint64_t bytes_hashed;
+    uint64_t files_copied;
+    uint64_t bytes_copied;
+    uint64_t files_linked;
+    uint64_t files_moved;
+    uint64_t chunks_stored;
+    uint64_t chunks_reused;
+    uint64_t syscalls;
+    uint64_t errors;
+} __attribute__((aligned(64))) worker_stats_t;
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t planned_files; // Copy work known once the diff is done (used for the ETA)
+    uint64_t planned_bytes;
+    uint32_t workers_count; // Number of slots ever used (reported)
+    uint32_t slots_next; // Next slot to give (slots of finished pools are given again)
+    worker_stats_t workers[STATS_MAX_WORKERS];
+} stats_block_t;
+
+extern worker_stats_t *my_stats;
+
+#define STATS_ADD(field, value) (my_stats->field += (value))
+
+int stats_init(bool enabled);
+void stats_attach_worker(const char *role);
+uint32_t stats_slots_mark(void);
+void stats_slots_release(uint32_t mark);
+uint64_t stats_now(void);
+uint64_t stats_begin(void);
+void stats_end(stats_phase_t phase, uint64_t start);
+void stats_plan(uint64_t files, uint64_t bytes);
+stats_block_t *stats_shared_block(void);
+int stats_report(const char *report_path);
+void stats_release(void);
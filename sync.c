@@ -1,3 +1,4 @@
+#define _GNU_SOURCE // SEEK_DATA et SEEK_HOLE
 #include <sync.h>
 #include <dirent.h>
 #include <string.h>
@@ -8,14 +9,825 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/sendfile.h>
+#include <openssl/md5.h>
 #include <unistd.h>
 #include <sys/msg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stats.h>
+#include <trace.h>
+#include <manifest.h>
+#include <extsort.h>
+#include <hardlinks.h>
+#include <metadata.h>
+#include <durability.h>
+#include <moves.h>
+#include <ratelimit.h>
+#include <cache.h>
+#include <filter.h>
+#include <journal.h>
+#include <snapshot.h>
+#include <chunkstore.h>
+#include <merkle.h>
+#include <remote.h>
+#include <verify.h>
+#include <diskorder.h>
+#include <pack.h>
+
+/*!
+ * @brief add_difference appends a copy of a source entry to the differences list
+ * @param difference is the differences list
+ * @param entry is the source entry to copy
+ */
+static void add_difference(files_list_t *difference, files_list_entry_t *entry) {
+    files_list_entry_t *tmp_copy = malloc(sizeof(files_list_entry_t));
+    if (tmp_copy == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        exit(-1);
+    }
+    memcpy(tmp_copy, entry, sizeof(files_list_entry_t));
+    tmp_copy->next = NULL;
+    add_entry_to_tail(difference, tmp_copy);
+}
+
+/*!
+ * @brief resolve_ambiguous_pairs compares by content the pairs of files whose metadata match
+ * Large files first go through a sampled prefilter: pairs whose samples differ are different without
+ * reading them fully. The remaining pairs get a full MD5 comparison.
+ * @param difference is the differences list, receiving the source entries of different pairs
+ * @param pairs is an array of 2 * count pointers: source entry, then destination entry, for each pair
+ * @param count is the number of pairs
+ * @param workers_count is the number of hashing processes
+ */
+static void resolve_ambiguous_pairs(files_list_t *difference, files_list_entry_t **pairs, size_t count, int workers_count) {
+    if (count == 0) {
+        return;
+    }
+    files_list_entry_t **to_hash = malloc(2 * count * sizeof(files_list_entry_t *));
+    if (to_hash == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        exit(-1);
+    }
+
+    // 1er étage : empreintes d'échantillons des gros fichiers
+    size_t sampled_count = 0;
+    for (size_t i=0; i<count; ++i) {
+        if (pairs[2 * i]->size >= SAMPLE_MIN_SIZE) {
+            to_hash[2 * sampled_count] = pairs[2 * i];
+            to_hash[2 * sampled_count + 1] = pairs[2 * i + 1];
+            sampled_count++;
+        }
+    }
+    compute_files_md5_parallel(to_hash, 2 * sampled_count, workers_count, HASH_SAMPLED);
+
+    // 2nd étage : empreintes complètes des petits fichiers et des paires dont les échantillons concordent
+    size_t full_count = 0;
+    for (size_t i=0; i<count; ++i) {
+        files_list_entry_t *source_entry = pairs[2 * i];
+        files_list_entry_t *destination_entry = pairs[2 * i + 1];
+        if (source_entry->size >= SAMPLE_MIN_SIZE && mismatch(source_entry, destination_entry, true)) {
+            // Les sommes d'échantillons ne sont pas des MD5 du fichier : elles ne doivent pas être conservées
+            memset(source_entry->md5sum, 0, sizeof(source_entry->md5sum));
+            memset(destination_entry->md5sum, 0, sizeof(destination_entry->md5sum));
+            add_difference(difference, source_entry);
+        } else {
+            to_hash[2 * full_count] = source_entry;
+            to_hash[2 * full_count + 1] = destination_entry;
+            full_count++;
+        }
+    }
+    compute_files_md5_parallel(to_hash, 2 * full_count, workers_count, HASH_FULL);
+    for (size_t i=0; i<full_count; ++i) {
+        if (mismatch(to_hash[2 * i], to_hash[2 * i + 1], true)) {
+            add_difference(difference, to_hash[2 * i]);
+        }
+    }
+    free(to_hash);
+}
+
+/*!
+ * @brief compare_entries_pointers is the qsort/bsearch comparison function for arrays of entries pointers
+ */
+static int compare_entries_pointers(const void *lhd, const void *rhd) {
+    files_list_entry_t *const *left = lhd;
+    files_list_entry_t *const *right = rhd;
+    return strcmp((*left)->path_and_name, (*right)->path_and_name);
+}
+
+/*!
+ * @brief update_destination_manifest writes the manifest of the destination after a synchronization
+ * The destination state is its former list, where copied entries are replaced by their new metadata
+ * (stat'ed in the destination, only for the copied entries). If an entry could not be copied, the
+ * synchronization is not complete and the former manifest is removed instead.
+ * @param destination is the destination list, as listed before the copy
+ * @param difference is the list of the copied source entries
+ * @param the_config is a pointer to the configuration
+ */
+static void update_destination_manifest(files_list_t *destination, files_list_t *difference, configuration_t *the_config) {
+    size_t start_of_src = strlen(the_config->source) + 1;
+    files_list_t synchronized = {NULL, NULL};
+    bool complete = true;
+
+    // Entrées copiées : métadonnées relevées dans la destination
+    size_t copied_count = 0;
+    for (files_list_entry_t *cursor = difference->head; cursor != NULL && complete; cursor = cursor->next) {
+        files_list_entry_t *copied = malloc(sizeof(files_list_entry_t));
+        if (copied == NULL) {
+            complete = false;
+            break;
+        }
+        memcpy(copied, cursor, sizeof(files_list_entry_t));
+        // Fichier empaqueté : l'index contient la version de la source, il n'y a rien à relever
+        int64_t mtime_ns = (int64_t)cursor->mtime.tv_sec * 1000000000LL + cursor->mtime.tv_nsec;
+        bool packed = cursor->entry_type == FICHIER && pack_holds(cursor->path_and_name + start_of_src, cursor->size, mtime_ns);
+        if (concat_path(copied->path_and_name, the_config->destination, cursor->path_and_name + start_of_src) == NULL
+            || (!packed && (get_file_metadata(copied) == -1 || copied->size != cursor->size))) {
+            free(copied);
+            complete = false;
+            break;
+        }
+        add_entry_to_tail(&synchronized, copied);
+        copied_count++;
+    }
+
+    // Autres entrées de la destination : inchangées
+    files_list_entry_t **copied_entries = malloc((copied_count ? copied_count : 1) * sizeof(files_list_entry_t *));
+    if (copied_entries == NULL) {
+        complete = false;
+    }
+    if (complete) {
+        size_t i = 0;
+        for (files_list_entry_t *cursor = synchronized.head; cursor != NULL; cursor = cursor->next) {
+            copied_entries[i++] = cursor;
+        }
+        qsort(copied_entries, copied_count, sizeof(files_list_entry_t *), compare_entries_pointers);
+        for (files_list_entry_t *cursor = destination->head; cursor != NULL && complete; cursor = cursor->next) {
+            if (bsearch(&cursor, copied_entries, copied_count, sizeof(files_list_entry_t *), compare_entries_pointers) != NULL) {
+                continue;
+            }
+            files_list_entry_t *unchanged = malloc(sizeof(files_list_entry_t));
+            if (unchanged == NULL) {
+                complete = false;
+                break;
+            }
+            memcpy(unchanged, cursor, sizeof(files_list_entry_t));
+            add_entry_to_tail(&synchronized, unchanged);
+        }
+    }
+    free(copied_entries);
+
+    if (!complete || manifest_write(&synchronized, the_config->destination) == -1) {
+        char manifest_path[PATH_SIZE];
+        if (concat_path(manifest_path, the_config->destination, MANIFEST_FILE_NAME) != NULL) {
+            unlink(manifest_path);
+        }
+        printf("Synchronisation incomplète : le manifeste de la destination n'est pas mis à jour\n");
+    }
+    clear_files_list(&synchronized);
+}
+
+/*!
+ * @brief list_destination_from_manifest loads the destination list from its manifest, when enabled and usable
+ * @param destination is the destination list to fill
+ * @param manifest is the manifest, left open when the list is loaded from it (to be closed by the caller)
+ * @param the_config is a pointer to the configuration
+ * @return true if the list was loaded from the manifest, false if the destination must be listed
+ */
+static bool list_destination_from_manifest(files_list_t *destination, manifest_t *manifest, configuration_t *the_config) {
+    bool destination_from_manifest = false;
+    if (the_config->use_manifest) {
+        if (manifest_open(manifest, the_config->destination) == 0) {
+            uint64_t list_start = stats_begin();
+            if (!the_config->verify_manifest || manifest_verify(manifest, the_config->destination)) {
+                destination_from_manifest = manifest_to_files_list(manifest, destination, the_config->destination) == 0;
+            } else {
+                printf("Le manifeste ne correspond plus à la destination, elle sera parcourue\n");
+            }
+            if (!destination_from_manifest) {
+                clear_files_list(destination);
+                destination->head = destination->tail = NULL;
+                manifest_close(manifest);
+            }
+            stats_end(PHASE_LIST, list_start);
+        }
+    }
+    return destination_from_manifest;
+}
+
+typedef struct {
+    merkle_item_t *source_items;
+    bool *changed;
+    size_t changed_count;
+} changed_sources_t;
+
+/*!
+ * @brief mark_changed_source is the merkle_diff callback: it flags the source entries to compare
+ */
+static void mark_changed_source(merkle_item_t *source_item, merkle_item_t *manifest_item, void *context) {
+    (void)manifest_item;
+    changed_sources_t *changes = context;
+    if (source_item != NULL) {
+        changes->changed[source_item - changes->source_items] = true;
+        changes->changed_count++;
+    }
+}
+
+/*!
+ * @brief compare_merkle_items is the qsort comparison function for Merkle items (by relative path)
+ */
+static int compare_merkle_items(const void *lhd, const void *rhd) {
+    return strcmp(((const merkle_item_t *)lhd)->relative_path, ((const merkle_item_t *)rhd)->relative_path);
+}
+
+/*!
+ * @brief restrict_to_changed_subtrees compares the source with the Merkle digests of the destination manifest
+ * Subtrees whose digest is unchanged are identical to the destination and are left out of the comparison:
+ * only the changed entries are added to the candidates list (and later compared by diff_lists). The source
+ * files left out are remembered for the hard links, as diff_lists does for identical files.
+ * @param source is the source list
+ * @param candidates is the list receiving copies of the source entries to compare
+ * @param the_config is a pointer to the configuration
+ * @return true if candidates holds the entries to compare, false if the whole source must be compared
+ */
+static bool restrict_to_changed_subtrees(files_list_t *source, files_list_t *candidates, configuration_t *the_config) {
+    manifest_t manifest;
+    if (manifest_open(&manifest, the_config->destination) == -1) {
+        return false;
+    }
+    size_t source_count = 0, manifest_count = manifest.header->entries_count;
+    for (files_list_entry_t *cursor = source->head; cursor != NULL; cursor = cursor->next) {
+        source_count++;
+    }
+    merkle_item_t *source_items = malloc((source_count ? source_count : 1) * sizeof(merkle_item_t));
+    merkle_item_t *manifest_items = malloc((manifest_count ? manifest_count : 1) * sizeof(merkle_item_t));
+    bool *changed = calloc(source_count ? source_count : 1, sizeof(bool));
+    if (source_items == NULL || manifest_items == NULL || changed == NULL) {
+        free(source_items);
+        free(manifest_items);
+        free(changed);
+        manifest_close(&manifest);
+        return false;
+    }
+
+    size_t start_of_src = strlen(the_config->source) + 1;
+    size_t kept = 0;
+    for (files_list_entry_t *cursor = source->head; cursor != NULL; cursor = cursor->next) {
+        if (strlen(cursor->path_and_name) > start_of_src) {
+            merkle_item_from_entry(&source_items[kept++], cursor, start_of_src);
+        }
+    }
+    qsort(source_items, kept, sizeof(merkle_item_t), compare_merkle_items);
+    for (size_t i=0; i<manifest_count; ++i) {
+        merkle_item_from_record(&manifest_items[i], &manifest, &manifest.records[i]);
+    }
+
+    // Même empreinte racine : aucune entrée à comparer ; sinon, descente dans les seuls sous-arbres différents
+    uint8_t root_digest[MERKLE_DIGEST_SIZE];
+    bool restricted = merkle_compute(source_items, kept, root_digest) == 0;
+    changed_sources_t changes = {source_items, changed, 0};
+    if (restricted && memcmp(root_digest, manifest.header->root_digest, MERKLE_DIGEST_SIZE) != 0) {
+        merkle_diff(source_items, kept, manifest_items, manifest_count, mark_changed_source, &changes);
+    }
+    if (restricted) {
+        for (size_t i=0; i<kept; ++i) {
+            files_list_entry_t *entry = source_items[i].payload;
+            if (changed[i]) {
+                add_difference(candidates, entry);
+            } else if (entry->entry_type == FICHIER) {
+                hardlinks_remember(entry, source_items[i].relative_path);
+            }
+        }
+        printf("Empreintes de Merkle : %zu entrées sur %zu à comparer\n", changes.changed_count, kept);
+    }
+    free(changed);
+    free(source_items);
+    free(manifest_items);
+    manifest_close(&manifest);
+    return restricted;
+}
+
+/*!
+ * @brief diff_lists compares the source list with a destination list
+ * @param source is the source list
+ * @param destination is the destination list
+ * @param manifest is the manifest the destination list was loaded from, NULL if it was listed
+ * @param difference is the differences list, receiving copies of the source entries to copy
+ * @param the_config is a pointer to the configuration
+ */
+static void diff_lists(files_list_t *source, files_list_t *destination, const manifest_t *manifest, files_list_t *difference, configuration_t *the_config) {
+    files_list_entry_t *tmp = source->head;
+
+    // Destination chargée depuis le manifeste : ses entrées sont exactement ses enregistrements, dans le même ordre
+    // (les fichiers empaquetés n'y sont pas ajoutés), retrouvés par recherche dichotomique au lieu d'un parcours de la liste
+    files_list_entry_t **recorded = NULL;
+    if (manifest != NULL) {
+        size_t recorded_count = manifest->header->entries_count, i = 0;
+        recorded = malloc((recorded_count ? recorded_count : 1) * sizeof(files_list_entry_t *));
+        for (files_list_entry_t *cursor = destination->head; cursor != NULL && recorded != NULL && i < recorded_count; cursor = cursor->next) {
+            recorded[i++] = cursor;
+        }
+        if (recorded != NULL && i < recorded_count) {
+            free(recorded);
+            recorded = NULL;
+        }
+    }
+
+    // Comparaison des fichiers source et destination
+    uint64_t diff_start = stats_begin();
+    TRACE_BEGIN("diff", "sync");
+    bool lazy_hashing = the_config->uses_md5 && the_config->lazy_md5;
+    files_list_entry_t **ambiguous = NULL;
+    size_t ambiguous_count = 0, ambiguous_capacity = 0;
+    while (tmp != NULL) {
+        size_t start_of_src = strlen(the_config->source) + 1;
+        size_t start_of_dest = strlen(the_config->destination) + 1;
+
+        files_list_entry_t *result = NULL;
+        if (recorded != NULL) {
+            const manifest_record_t *record = manifest_lookup(manifest, tmp->path_and_name + start_of_src);
+            result = record != NULL ? recorded[record - manifest->records] : NULL;
+        } else {
+            result = find_entry_by_name(destination, tmp->path_and_name, start_of_src, start_of_dest);
+        }
+
+        if (result != NULL && journal_is_done(tmp) && !mismatch(tmp, result, false)) {
+            // Copie achevée par une exécution interrompue : ni empreinte ni copie
+            hardlinks_remember(tmp, result->path_and_name + start_of_dest);
+        } else if (lazy_hashing && result != NULL && result->entry_type == FICHIER && !mismatch(tmp, result, false)
+                   && pack_holds(result->path_and_name + start_of_dest, result->size, (int64_t)result->mtime.tv_sec * 1000000000LL + result->mtime.tv_nsec)) {
+            // Fichier empaqueté : son empreinte est dans l'index, seule celle de la source est calculée
+            if (compute_file_md5(tmp) == -1 || mismatch(tmp, result, true)) {
+                add_difference(difference, tmp);
+            }
+        } else if (lazy_hashing && result != NULL && result->entry_type == FICHIER && !mismatch(tmp, result, false)) {
+            // Métadonnées identiques : seule l'empreinte peut départager, elle sera calculée après le parcours
+            if (ambiguous_count == ambiguous_capacity) {
+                ambiguous_capacity = ambiguous_capacity ? ambiguous_capacity * 2 : 64;
+                ambiguous = realloc(ambiguous, ambiguous_capacity * 2 * sizeof(files_list_entry_t *));
+                if (ambiguous == NULL) {
+                    printf("Erreur d'allocation mémoire\n");
+                    exit(-1);
+                }
+            }
+            ambiguous[2 * ambiguous_count] = tmp;
+            ambiguous[2 * ambiguous_count + 1] = result;
+            ambiguous_count++;
+        } else if (result == NULL || mismatch(tmp, result, the_config->uses_md5)) {
+            // Ajout des fichiers différents à la liste de différences
+            add_difference(difference, tmp);
+        } else {
+            printf("\nLes fichiers sont identiques\n");
+            // Les autres liens du même inode pourront pointer vers ce fichier
+            hardlinks_remember(tmp, result->path_and_name + start_of_dest);
+        }
+
+        tmp = tmp->next;
+    }
+
+    // Mode paresseux : hachage en parallèle des seules paires ambiguës (source et destination)
+    resolve_ambiguous_pairs(difference, ambiguous, ambiguous_count, the_config->processes_count);
+    free(ambiguous);
+    free(recorded);
+
+    // Détection des fichiers déplacés : nouveaux dans la source, mais déjà présents ailleurs dans la destination
+    if (the_config->detect_moves) {
+        moves_plan(source, destination, difference, the_config);
+    }
+    TRACE_END("diff", "sync");
+    stats_end(PHASE_DIFF, diff_start);
+}
+
+/*!
+ * @brief entry_from_record builds a files list entry from an entry of a sorted stream
+ * @param result is the entry to fill
+ * @param root is the root of the tree the stream was built from
+ * @param record is the stream entry
+ */
+static void entry_from_record(files_list_entry_t *result, char *root, extsort_entry_t *record) {
+    memset(result, 0, sizeof(files_list_entry_t));
+    snprintf(result->path_and_name, sizeof(result->path_and_name), "%s/%s", root, record->path);
+    result->size = record->header.size;
+    result->mtime.tv_sec = record->header.mtime_ns / 1000000000LL;
+    result->mtime.tv_nsec = record->header.mtime_ns % 1000000000LL;
+    result->mode = record->header.mode;
+    result->device = record->header.device;
+    result->inode = record->header.inode;
+    result->links_count = record->header.links_count;
+    result->entry_type = record->header.entry_type == DOSSIER ? DOSSIER : FICHIER;
+}
+
+/*!
+ * @brief synchronize_external synchronizes with a bounded memory (--memory-limit)
+ * Both trees are listed into sorted streams on disk (@see extsort_list_tree), then the two streams
+ * are walked together like a merge: each entry is compared and copied as soon as it is read, so
+ * neither the lists nor the differences are ever held in memory.
+ * @param the_config is a pointer to the configuration
+ */
+static void synchronize_external(configuration_t *the_config) {
+    FILE *source_stream = extsort_list_tree(the_config->source, the_config->memory_limit);
+    FILE *destination_stream = extsort_list_tree(the_config->destination, the_config->memory_limit);
+    if (source_stream == NULL || destination_stream == NULL) {
+        printf("Erreur lors du listage des arborescences\n");
+        if (source_stream != NULL) {
+            fclose(source_stream);
+        }
+        if (destination_stream != NULL) {
+            fclose(destination_stream);
+        }
+        return;
+    }
+
+    // Les entrées sont grandes (chemins) : elles ne sont pas allouées sur la pile
+    extsort_reader_t *source_reader = malloc(sizeof(extsort_reader_t));
+    extsort_reader_t *destination_reader = malloc(sizeof(extsort_reader_t));
+    files_list_entry_t *source_entry = malloc(sizeof(files_list_entry_t));
+    files_list_entry_t *destination_entry = malloc(sizeof(files_list_entry_t));
+    if (source_reader == NULL || destination_reader == NULL || source_entry == NULL || destination_entry == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        exit(-1);
+    }
+
+    durability_init(the_config->durability, the_config->destination);
+    if (the_config->use_journal && !the_config->is_dry_run) {
+        journal_open(the_config);
+    }
+    // Dossiers dont les métadonnées sont différées : sur disque, comme les listes
+    metadata_spill_directories();
+    bool completed = true;
+    // Une erreur de lecture d'un flux interrompt la synchronisation : la prendre pour sa fin ignorerait des entrées
+    bool read_failed = extsort_reader_open(source_reader, source_stream) == -1
+        || extsort_reader_open(destination_reader, destination_stream) == -1;
+    while (!read_failed && source_reader->valid) {
+        // Avance dans la destination jusqu'au chemin courant de la source
+        int comparison = 1;
+        while (!read_failed && destination_reader->valid && (comparison = strcmp(destination_reader->current.path, source_reader->current.path)) < 0) {
+            read_failed = extsort_reader_next(destination_reader) == -1;
+        }
+        if (read_failed) {
+            break;
+        }
+        if (!destination_reader->valid) {
+            comparison = 1;
+        }
+
+        uint64_t diff_start = stats_begin();
+        entry_from_record(source_entry, the_config->source, &source_reader->current);
+        bool different = comparison != 0;
+        if (!different) {
+            entry_from_record(destination_entry, the_config->destination, &destination_reader->current);
+            different = mismatch(source_entry, destination_entry, false);
+            if (!different && the_config->uses_md5 && source_entry->entry_type == FICHIER && !journal_is_done(source_entry)) {
+                different = compute_file_md5(source_entry) == -1 || compute_file_md5(destination_entry) == -1
+                    || mismatch(source_entry, destination_entry, true);
+            }
+        }
+        stats_end(PHASE_DIFF, diff_start);
+
+        if (different) {
+            copy_entry_to_destination(source_entry, the_config);
+            completed = completed && (source_entry->entry_type != FICHIER || !journal_enabled || journal_is_done(source_entry));
+        } else {
+            hardlinks_remember(source_entry, destination_entry->path_and_name + strlen(the_config->destination) + 1);
+        }
+        read_failed = extsort_reader_next(source_reader) == -1;
+    }
+    if (read_failed) {
+        printf("Erreur de lecture d'une liste triée : synchronisation interrompue\n");
+        STATS_ADD(errors, 1);
+        completed = false;
+    }
+
+    free(source_reader);
+    free(destination_reader);
+    free(source_entry);
+    free(destination_entry);
+    fclose(source_stream);
+    fclose(destination_stream);
+    metadata_apply_directories();
+    durability_finish();
+    journal_close(completed);
+    hardlinks_clear();
+}
+
+/*!
+ * @brief synchronize_fan_out synchronizes the source with several destinations (fan-out)
+ * The source is listed (and hashed) once, each destination is compared with it, then the source is walked
+ * once: every entry is read once and written into all the destinations where it differs.
+ * @param the_config is a pointer to the configuration
+ */
+static void synchronize_fan_out(configuration_t *the_config) {
+    int count = 1 + the_config->extra_destinations_count;
+    configuration_t *configs = malloc(count * sizeof(configuration_t));
+    files_list_t *destinations = calloc(count, sizeof(files_list_t));
+    files_list_t *differences = calloc(count, sizeof(files_list_t));
+    files_list_entry_t ***sorted_differences = calloc(count, sizeof(files_list_entry_t **));
+    size_t *differences_count = calloc(count, sizeof(size_t));
+    if (configs == NULL || destinations == NULL || differences == NULL || sorted_differences == NULL || differences_count == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        exit(-1);
+    }
+    // Une configuration par destination, pour réutiliser le parcours, la comparaison, la copie et le manifeste
+    for (int i=0; i<count; ++i) {
+        configs[i] = *the_config;
+        configs[i].detect_moves = false; // Renommer dans une destination n'a pas de sens pour les autres
+        if (i > 0) {
+            strcpy(configs[i].destination, the_config->extra_destinations[i - 1]);
+        }
+    }
+
+    files_list_t source = {NULL, NULL};
+    make_files_list(&source, the_config->source);
+
+    uint64_t planned_files = 0, planned_bytes = 0;
+    for (int i=0; i<count; ++i) {
+        manifest_t manifest;
+        bool destination_from_manifest = list_destination_from_manifest(&destinations[i], &manifest, &configs[i]);
+        if (!destination_from_manifest) {
+            make_files_list(&destinations[i], configs[i].destination);
+        }
+        diff_lists(&source, &destinations[i], destination_from_manifest ? &manifest : NULL, &differences[i], &configs[i]);
+        if (destination_from_manifest) {
+            manifest_close(&manifest);
+        }
+
+        // Différences triées par chemin, pour retrouver les destinations de chaque entrée de la source
+        for (files_list_entry_t *cursor = differences[i].head; cursor != NULL; cursor = cursor->next) {
+            differences_count[i]++;
+        }
+        sorted_differences[i] = malloc((differences_count[i] ? differences_count[i] : 1) * sizeof(files_list_entry_t *));
+        if (sorted_differences[i] == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            exit(-1);
+        }
+        size_t j = 0;
+        for (files_list_entry_t *cursor = differences[i].head; cursor != NULL; cursor = cursor->next) {
+            sorted_differences[i][j++] = cursor;
+            planned_files++;
+            if (cursor->entry_type == FICHIER) {
+                planned_bytes += cursor->size;
+            }
+        }
+        qsort(sorted_differences[i], differences_count[i], sizeof(files_list_entry_t *), compare_entries_pointers);
+    }
+    stats_plan(planned_files, planned_bytes);
+
+    // Copie dans l'ordre de la source : chaque entrée est lue une fois pour toutes ses destinations
+    durability_init(the_config->durability, configs[0].destination);
+    for (int i=1; i<count; ++i) {
+        durability_add_destination(configs[i].destination);
+    }
+    configuration_t *targets[1 + MAX_EXTRA_DESTINATIONS];
+    for (files_list_entry_t *cursor = source.head; cursor != NULL; cursor = cursor->next) {
+        int targets_count = 0;
+        for (int i=0; i<count; ++i) {
+            files_list_entry_t **found = bsearch(&cursor, sorted_differences[i], differences_count[i], sizeof(files_list_entry_t *), compare_entries_pointers);
+            if (found != NULL) {
+                targets[targets_count++] = &configs[i];
+            }
+        }
+        if (targets_count > 0) {
+            copy_entry_to_destinations(cursor, targets, targets_count);
+        }
+    }
+    metadata_apply_directories();
+    durability_finish();
+
+    for (int i=0; i<count; ++i) {
+        if (the_config->use_manifest && !the_config->is_dry_run) {
+            update_destination_manifest(&destinations[i], &differences[i], &configs[i]);
+        }
+        free(sorted_differences[i]);
+        clear_files_list(&differences[i]);
+        clear_files_list(&destinations[i]);
+    }
+    hardlinks_clear();
+    clear_files_list(&source);
+    free(differences_count);
+    free(sorted_differences);
+    free(differences);
+    free(destinations);
+    free(configs);
+}
+
+/*!
+ * @brief synchronize_chunk_store synchronizes the source into a deduplicating chunk store (--chunk-store)
+ * Directories are mirrored; each file is stored as a recipe (list of chunks) at its path, its content being
+ * split into content-defined chunks written once into the store (@see chunkstore_store_file).
+ * @param the_config is a pointer to the configuration
+ */
+static void synchronize_chunk_store(configuration_t *the_config) {
+    if (chunkstore_open(the_config->destination) == -1) {
+        return;
+    }
+    files_list_t source = {NULL, NULL};
+    make_files_list(&source, the_config->source);
+    size_t start_of_src = strlen(the_config->source) + 1;
+
+    // Recettes à jour (taille, date et mode) : fichier inchangé, ni lu ni découpé
+    uint64_t diff_start = stats_begin();
+    TRACE_BEGIN("diff", "sync");
+    files_list_t changed = {NULL, NULL};
+    uint64_t planned_files = 0, planned_bytes = 0;
+    for (files_list_entry_t *cursor = source.head; cursor != NULL; cursor = cursor->next) {
+        char recipe_path[PATH_SIZE];
+        if (cursor->entry_type == FICHIER
+            && concat_path(recipe_path, the_config->destination, cursor->path_and_name + start_of_src) != NULL
+            && chunkstore_is_current(recipe_path, cursor)) {
+            continue;
+        }
+        add_difference(&changed, cursor);
+        planned_files++;
+        planned_bytes += cursor->entry_type == FICHIER ? cursor->size : 0;
+    }
+    TRACE_END("diff", "sync");
+    stats_end(PHASE_DIFF, diff_start);
+    stats_plan(planned_files, planned_bytes);
+
+    durability_init(the_config->durability, the_config->destination);
+    for (files_list_entry_t *cursor = changed.head; cursor != NULL; cursor = cursor->next) {
+        char recipe_path[PATH_SIZE];
+        if (cursor->entry_type == DOSSIER) {
+            copy_entry_to_destination(cursor, the_config);
+        } else if (concat_path(recipe_path, the_config->destination, cursor->path_and_name + start_of_src) != NULL) {
+            chunkstore_store_file(cursor, recipe_path);
+        }
+    }
+    metadata_apply_directories();
+    durability_finish();
+
+    chunkstore_close();
+    clear_files_list(&changed);
+    clear_files_list(&source);
+}
+
+/*!
+ * @brief synchronize_snapshot writes the source into a new dated snapshot of the destination (--snapshot)
+ * The source is compared with the previous snapshot: changed entries are copied, unchanged files are
+ * hard-linked to their copy in the previous snapshot, so a snapshot only costs the changed bytes.
+ * @param the_config is a pointer to the configuration
+ */
+static void synchronize_snapshot(configuration_t *the_config) {
+    char previous_path[PATH_SIZE], current_path[PATH_SIZE];
+    if (snapshot_prepare(the_config->destination, previous_path, current_path) == -1) {
+        return;
+    }
+    // Comparaison avec l'instantané précédent, écriture dans le nouveau
+    configuration_t previous_config = *the_config, current_config = *the_config;
+    previous_config.detect_moves = current_config.detect_moves = false;
+    strcpy(previous_config.destination, previous_path);
+    strcpy(current_config.destination, current_path);
+
+    files_list_t source = {NULL, NULL}, previous = {NULL, NULL}, difference = {NULL, NULL};
+    make_files_list(&source, the_config->source);
+    if (previous_path[0] != '\0') {
+        make_files_list(&previous, previous_path);
+    }
+    diff_lists(&source, &previous, NULL, &difference, &previous_config);
+
+    size_t differences_count = 0;
+    uint64_t planned_bytes = 0;
+    for (files_list_entry_t *cursor = difference.head; cursor != NULL; cursor = cursor->next) {
+        differences_count++;
+        planned_bytes += cursor->entry_type == FICHIER ? cursor->size : 0;
+    }
+    files_list_entry_t **sorted_differences = malloc((differences_count ? differences_count : 1) * sizeof(files_list_entry_t *));
+    if (sorted_differences == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        exit(-1);
+    }
+    size_t i = 0;
+    for (files_list_entry_t *cursor = difference.head; cursor != NULL; cursor = cursor->next) {
+        sorted_differences[i++] = cursor;
+    }
+    qsort(sorted_differences, differences_count, sizeof(files_list_entry_t *), compare_entries_pointers);
+    stats_plan(differences_count, planned_bytes);
+
+    // Tous les dossiers sont recréés, les fichiers inchangés sont des liens vers l'instantané précédent
+    durability_init(the_config->durability, current_path);
+    size_t start_of_src = strlen(the_config->source) + 1;
+    bool completed = true;
+    for (files_list_entry_t *cursor = source.head; cursor != NULL; cursor = cursor->next) {
+        bool changed = bsearch(&cursor, sorted_differences, differences_count, sizeof(files_list_entry_t *), compare_entries_pointers) != NULL;
+        if (!changed && cursor->entry_type == FICHIER) {
+            char previous_file[PATH_SIZE], current_file[PATH_SIZE];
+            STATS_ADD(syscalls, 1);
+            if (concat_path(previous_file, previous_path, cursor->path_and_name + start_of_src) != NULL
+                && concat_path(current_file, current_path, cursor->path_and_name + start_of_src) != NULL
+                && link(previous_file, current_file) == 0) {
+                STATS_ADD(files_linked, 1);
+                continue;
+            }
+            // Trop de liens (EMLINK) ou fichier disparu de l'instantané précédent : copie
+        }
+        copy_entry_to_destination(cursor, &current_config);
+        if (cursor->entry_type == FICHIER) {
+            struct stat info;
+            char current_file[PATH_SIZE];
+            completed = completed && concat_path(current_file, current_path, cursor->path_and_name + start_of_src) != NULL
+                && lstat(current_file, &info) == 0 && (uint64_t)info.st_size == cursor->size;
+        }
+    }
+    metadata_apply_directories();
+    durability_finish();
+
+    // Seul un instantané complet sert de base au suivant
+    if (completed) {
+        snapshot_publish(the_config->destination, current_path);
+    } else {
+        printf("Instantané incomplet : %s n'est pas publié\n", current_path);
+    }
+
+    free(sorted_differences);
+    hardlinks_clear();
+    clear_files_list(&difference);
+    clear_files_list(&previous);
+    clear_files_list(&source);
+}
+
+/*!
+ * @brief synchronize_remote synchronizes the source into a destination owned by a receiver (tcp:// or unix://)
+ * The receiver lists its tree while the source is listed here; the comparison is local, then the
+ * differences are streamed in batched frames without waiting for the receiver, which only answers once
+ * at the end (@see remote_serve).
+ * @param the_config is a pointer to the configuration
+ */
+static void synchronize_remote(configuration_t *the_config) {
+    if (the_config->use_manifest || the_config->use_journal || the_config->detect_moves || the_config->memory_limit > 0
+        || the_config->durability != DURABILITY_NONE) {
+        printf("--manifest, --journal, --detect-moves, --memory-limit et --durability ne s'appliquent pas à une destination distante\n");
+    }
+    if (remote_connect(the_config->destination, the_config->uses_md5) == -1) {
+        return;
+    }
+    files_list_t source = {NULL, NULL}, destination = {NULL, NULL}, difference = {NULL, NULL};
+    make_files_list(&source, the_config->source);
+    if (remote_list_destination(&destination, the_config->destination) == -1) {
+        clear_files_list(&source);
+        return;
+    }
+
+    // Les empreintes de la destination sont calculées par le récepteur, celles de la source toutes ici
+    configuration_t remote_config = *the_config;
+    remote_config.lazy_md5 = false;
+    remote_config.detect_moves = false;
+    if (the_config->uses_md5) {
+        size_t count = 0;
+        for (files_list_entry_t *cursor = source.head; cursor != NULL; cursor = cursor->next) {
+            count += cursor->entry_type == FICHIER;
+        }
+        files_list_entry_t **files = malloc((count ? count : 1) * sizeof(files_list_entry_t *));
+        if (files == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            exit(-1);
+        }
+        size_t i = 0;
+        for (files_list_entry_t *cursor = source.head; cursor != NULL; cursor = cursor->next) {
+            if (cursor->entry_type == FICHIER) {
+                files[i++] = cursor;
+            }
+        }
+        compute_files_md5_parallel(files, count, the_config->processes_count, HASH_FULL);
+        free(files);
+    }
+    diff_lists(&source, &destination, NULL, &difference, &remote_config);
+
+    uint64_t planned_files = 0, planned_bytes = 0;
+    for (files_list_entry_t *cursor = difference.head; cursor != NULL; cursor = cursor->next) {
+        planned_files++;
+        planned_bytes += cursor->entry_type == FICHIER ? cursor->size : 0;
+    }
+    stats_plan(planned_files, planned_bytes);
+
+    size_t start_of_src = strlen(the_config->source) + 1;
+    for (files_list_entry_t *cursor = difference.head; cursor != NULL; cursor = cursor->next) {
+        if (the_config->is_dry_run) {
+            printf("A synchroniser : %s\n", cursor->path_and_name + start_of_src);
+        } else if (remote_send_entry(cursor, cursor->path_and_name + start_of_src) == -1) {
+            break;
+        }
+    }
+    remote_result_t result;
+    if (remote_finish(&result) == 0) {
+        printf("Destination distante : %llu entrées écrites, %llu erreurs\n",
+               (unsigned long long)result.entries_written, (unsigned long long)result.errors);
+        STATS_ADD(errors, result.errors);
+    }
+
+    clear_files_list(&difference);
+    clear_files_list(&source);
+    clear_files_list(&destination);
+}
 
 /*!
  * @brief synchronize is the main function for synchronization
  * It will build the lists (source and destination), then make a third list with differences, and apply differences to the destination
  * It must adapt to the parallel or not operation of the program.
+ * In lazy MD5 mode, files are only hashed when they exist on both sides with identical metadata.
+ * With a manifest, the destination is read from its manifest instead of being listed, and the manifest
+ * is rewritten after the copy. Its Merkle digests limit the comparison to the subtrees that changed.
+ * With a memory limit, the synchronization is delegated to synchronize_external.
+ * A remote destination (tcp:// or unix://) is delegated to synchronize_remote.
  * @param the_config is a pointer to the configuration
  * @param p_context is a pointer to the processes context
  */
@@ -25,59 +837,148 @@ void synchronize(configuration_t *the_config, process_context_t *p_context) {
         exit(-1);
     }
 
+    // Les packs ne sont gérés que par la synchronisation par listes
+    if (the_config->pack_threshold > 0 && (remote_is_address(the_config->destination) || the_config->chunk_store || the_config->snapshot
+        || the_config->extra_destinations_count > 0 || the_config->memory_limit > 0)) {
+        printf("--pack-small ne s'applique pas à ce mode de synchronisation, il est ignoré\n");
+    }
+
+    // Destination distante : possédée par un récepteur (--serve), jointe par TCP ou socket Unix
+    if (remote_is_address(the_config->destination)) {
+        synchronize_remote(the_config);
+        return;
+    }
+
+    // Magasin de morceaux : la destination ne contient que des recettes et les morceaux uniques
+    if (the_config->chunk_store) {
+        synchronize_chunk_store(the_config);
+        return;
+    }
+
+    // Instantanés datés : la destination contient un dossier par exécution
+    if (the_config->snapshot) {
+        synchronize_snapshot(the_config);
+        return;
+    }
+
+    // Plusieurs destinations : lecture unique de la source (la mémoire bornée ne gère qu'une destination)
+    if (the_config->extra_destinations_count > 0) {
+        if (the_config->memory_limit > 0) {
+            printf("--memory-limit ne s'applique qu'à une seule destination, il est ignoré\n");
+        }
+        synchronize_fan_out(the_config);
+        return;
+    }
+
+    // Mémoire bornée : listes triées sur disque et comparaison au fil de l'eau
+    if (the_config->memory_limit > 0) {
+        synchronize_external(the_config);
+        return;
+    }
+
     // Initialisation des listes source et destination
     files_list_t source, destination, difference;
     source.head = source.tail = NULL;
     destination.head = destination.tail = NULL;
     difference.head = difference.tail = NULL;
 
+    // Petits fichiers empaquetés : l'index des packs décrit leur version dans la destination
+    if (the_config->pack_threshold > 0) {
+        pack_open(the_config->destination, the_config->pack_threshold, the_config->durability != DURABILITY_NONE);
+    }
+
+    // Le manifeste de la destination remplace son parcours lorsqu'il est disponible (et vérifié si demandé)
+    manifest_t manifest;
+    bool destination_from_manifest = list_destination_from_manifest(&destination, &manifest, the_config);
+
     // Création des listes de fichiers en fonction du mode de synchronisation
-    if (!the_config->is_parallel) {
+    if (destination_from_manifest) {
+        make_files_list(&source, the_config->source);
+    } else if (!the_config->is_parallel) {
         make_files_list(&source, the_config->source);
         make_files_list(&destination, the_config->destination);
     } else {
         make_files_lists_parallel(&source, &destination, the_config, p_context->message_queue_id);
     }
+    // Les fichiers empaquetés sont comparés comme des fichiers ordinaires de la destination
+    if (!destination_from_manifest && pack_enabled) {
+        pack_add_to_list(&destination, the_config->destination);
+    }
 
     // Affichage des fichiers source et destination
     display_files_list(&source);
     display_files_list(&destination);
 
-    files_list_entry_t *tmp = source.head;
-
-    // Comparaison des fichiers source et destination
-    while (tmp != NULL) {
-        size_t start_of_src = strlen(the_config->source) + 1;
-        size_t start_of_dest = strlen(the_config->destination) + 1;
-
-        files_list_entry_t *result = find_entry_by_name(&destination, tmp->path_and_name, start_of_src, start_of_dest);
+    // Journal d'une exécution interrompue : copies achevées ignorées, copies partielles reprises
+    if (the_config->use_journal && !the_config->is_dry_run) {
+        journal_open(the_config);
+    }
 
-        if (result == NULL || mismatch(tmp, result, the_config->uses_md5)) {
+    // Comparaison des fichiers source et destination, limitée aux sous-arbres dont l'empreinte de Merkle a changé
+    // (sans MD5 ni détection des déplacements, qui ont besoin de toutes les entrées)
+    files_list_t candidates = {NULL, NULL};
+    if (destination_from_manifest && !the_config->uses_md5 && !the_config->detect_moves
+        && restrict_to_changed_subtrees(&source, &candidates, the_config)) {
+        diff_lists(&candidates, &destination, &manifest, &difference, the_config);
+    } else {
+        diff_lists(&source, &destination, destination_from_manifest ? &manifest : NULL, &difference, the_config);
+    }
+    clear_files_list(&candidates);
+    if (destination_from_manifest) {
+        manifest_close(&manifest);
+    }
 
-            // Ajout des fichiers différents à la liste de différences
-            files_list_entry_t *tmp_copy = malloc(sizeof(files_list_entry_t));
-            if (tmp_copy == NULL) {
-                printf("Erreur d'allocation mémoire\n");
-                exit(-1);
-            }
-            memcpy(tmp_copy, tmp, sizeof(files_list_entry_t));
-            tmp_copy->next = NULL;
-            add_entry_to_tail(&difference, tmp_copy);
-        } else {
-            printf("\nLes fichiers sont identiques\n");
+    // Volume à copier, pour l'estimation du temps restant
+    uint64_t planned_files = 0, planned_bytes = 0;
+    for (files_list_entry_t *cursor = difference.head; cursor != NULL; cursor = cursor->next) {
+        planned_files++;
+        if (cursor->entry_type == FICHIER) {
+            planned_bytes += cursor->size;
         }
+    }
+    stats_plan(planned_files, planned_bytes);
 
-        tmp = tmp->next;
+    // Ordre physique : dossiers d'abord, puis fichiers dans l'ordre de leurs données sur le disque
+    if (diskorder_enabled) {
+        diskorder_sort_list(&difference);
     }
 
     // Copie des fichiers de la liste de différences vers la destination
+    durability_init(the_config->durability, the_config->destination);
     files_list_entry_t *tmp_dif = difference.head;
+    int until_prefetch = 0;
     while (tmp_dif != NULL) {
+        // Petits fichiers lus par lots : une seule passe du disque pour tout le lot
+        if (diskorder_enabled && until_prefetch-- == 0) {
+            diskorder_prefetch(tmp_dif);
+            until_prefetch = DISKORDER_BATCH_FILES - 1;
+        }
         copy_entry_to_destination(tmp_dif, the_config);
         tmp_dif = tmp_dif->next;
     }
+    // Packs et index écrits (les fichiers ordinaires remplacés sont alors supprimés de leurs dossiers)
+    pack_flush();
+    // Phase des métadonnées des dossiers, après l'écriture de tout leur contenu
+    metadata_apply_directories();
+    // Le manifeste n'est écrit qu'une fois les copies rendues durables
+    durability_finish();
+    // Le journal n'est plus utile une fois toutes les différences synchronisées
+    bool completed = true;
+    for (files_list_entry_t *cursor = difference.head; cursor != NULL && journal_enabled; cursor = cursor->next) {
+        completed = completed && (cursor->entry_type != FICHIER || journal_is_done(cursor));
+    }
+    journal_close(completed);
+    // Les anciens chemins des fichiers renommés n'existent plus dans la destination
+    moves_prune_destination(&destination);
+
+    // Enregistrement de l'état de la destination pour la prochaine exécution
+    if (the_config->use_manifest && !the_config->is_dry_run) {
+        update_destination_manifest(&destination, &difference, the_config);
+    }
+    pack_close();
 
     // Nettoyage des listes de fichiers
+    hardlinks_clear();
     clear_files_list(&difference);
     clear_files_list(&source);
     clear_files_list(&destination);
@@ -99,8 +1000,8 @@ bool mismatch(files_list_entry_t *lhd, files_list_entry_t *rhd, bool has_md5) {
     return true; 
   }
 
-  // Comparaison des attributs des fichiers
-  if (lhd->size != rhd->size ||
+  // Comparaison des attributs des fichiers (la taille d'un dossier dépend du système de fichiers)
+  if ((lhd->entry_type == FICHIER && lhd->size != rhd->size) ||
     lhd->mtime.tv_sec != rhd->mtime.tv_sec ||
     lhd->mtime.tv_nsec != rhd->mtime.tv_nsec ||
     lhd->entry_type != rhd->entry_type ||
@@ -135,7 +1036,9 @@ void make_files_list(files_list_t *list, char *target_path) {
   }
 
   // Appel de la fonction pour construire la liste de fichiers
+  uint64_t list_start = stats_begin();
   make_list(list, target_path);
+  stats_end(PHASE_LIST, list_start);
 }
 
 
@@ -154,6 +1057,7 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
     }
 
     fflush(stdout);
+    uint64_t list_start = stats_begin();
 
     // Envoi des commandes d'analyse de répertoire pour le source et la destination
     send_analyze_dir_command(msg_queue, COMMAND_CODE_ANALYZE_DIR, the_config->source);
@@ -166,10 +1070,12 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
 
     // Boucle pour recevoir les réponses des analyseurs en parallèle
     do {
+        TRACE_BEGIN("msg_recv_wait", "ipc");
         receive_messages(msg_queue, COMMAND_CODE_FILE_ENTRY, &source_response);
         receive_messages(msg_queue, COMMAND_CODE_FILE_ENTRY, &destination_response);
         receive_messages(msg_queue, COMMAND_CODE_FILE_ANALYZED, &src_end);
         receive_messages(msg_queue, COMMAND_CODE_FILE_ANALYZED, &dst_end);
+        TRACE_END("msg_recv_wait", "ipc");
 
         // Processus pour gérer les réponses des analyseurs
         if (source_response.list_entry.op_code == COMMAND_CODE_ANALYZE_FILE) {
@@ -181,6 +1087,7 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
             }
             memcpy(tmp_copy, &source_response.list_entry.payload, sizeof(files_list_entry_t));
             add_entry_to_tail(src_list, tmp_copy);
+            STATS_ADD(entries_listed, 1);
         }
 
         if (destination_response.list_entry.op_code == COMMAND_CODE_ANALYZE_FILE) {
@@ -192,6 +1099,7 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
             }
             memcpy(tmp_copy, &destination_response.list_entry.payload, sizeof(files_list_entry_t));
             add_entry_to_tail(dst_list, tmp_copy);
+            STATS_ADD(entries_listed, 1);
         }
 
         if (src_end.simple_command.message == COMMAND_CODE_LIST_COMPLETE) {
@@ -205,6 +1113,7 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
         }
 
     } while (source_loop || destination_loop);
+    stats_end(PHASE_LIST, list_start);
 
     // Envoi de la confirmation de terminaison
     int result = send_terminate_confirm(msg_queue, COMMAND_CODE_TERMINATE_OK);
@@ -214,6 +1123,325 @@ void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, c
     }
 }
 
+// Tampon des copies hachées au passage (un seul processus copie à la fois)
+static uint8_t hashed_copy_buffer[HASHED_COPY_BUFFER_SIZE];
+
+/*!
+ * @brief hash_zeros feeds the holes of a sparse file into a digest, as the zeros they read as
+ * @param digest is the MD5 context
+ * @param length is the length of the hole
+ */
+static void hash_zeros(MD5_CTX *digest, off_t length) {
+    static const uint8_t zeros[SAMPLE_BLOCK_SIZE];
+    while (length > 0) {
+        size_t chunk = length > (off_t)sizeof(zeros) ? sizeof(zeros) : (size_t)length;
+        MD5_Update(digest, zeros, chunk);
+        length -= chunk;
+    }
+}
+
+/*!
+ * @brief hash_source_range feeds a range of the source into a digest without copying it
+ * Used when an interrupted copy is resumed: the part already copied is read again for the digest only.
+ * @return 0 in case of success, -1 else
+ */
+static int hash_source_range(int source_fd, off_t offset, off_t length, MD5_CTX *digest) {
+    while (length > 0) {
+        size_t chunk = length > HASHED_COPY_BUFFER_SIZE ? HASHED_COPY_BUFFER_SIZE : (size_t)length;
+        RATELIMIT(chunk);
+        ssize_t bytes_read = pread(source_fd, hashed_copy_buffer, chunk, offset);
+        STATS_ADD(syscalls, 1);
+        if (bytes_read <= 0) {
+            return -1;
+        }
+        MD5_Update(digest, hashed_copy_buffer, bytes_read);
+        STATS_ADD(bytes_hashed, bytes_read);
+        offset += bytes_read;
+        length -= bytes_read;
+    }
+    return 0;
+}
+
+/*!
+ * @brief copy_chunk_hashed copies a chunk through the hashed copy buffer, feeding it into a digest
+ * @param source_fd is the source file descriptor
+ * @param dest_fd is the destination file descriptor
+ * @param offset is the offset of the chunk, moved past the bytes copied
+ * @param chunk is the size of the chunk (at most HASHED_COPY_BUFFER_SIZE)
+ * @param digest is the MD5 context
+ * @return the number of bytes copied (0 at the end of the source), -1 in case of error
+ */
+static ssize_t copy_chunk_hashed(int source_fd, int dest_fd, off_t *offset, size_t chunk, MD5_CTX *digest) {
+    ssize_t bytes_read = pread(source_fd, hashed_copy_buffer, chunk, *offset);
+    STATS_ADD(syscalls, 1);
+    if (bytes_read <= 0) {
+        return bytes_read;
+    }
+    MD5_Update(digest, hashed_copy_buffer, bytes_read);
+    STATS_ADD(bytes_hashed, bytes_read);
+    for (ssize_t written = 0; written < bytes_read; ) {
+        ssize_t result = pwrite(dest_fd, hashed_copy_buffer + written, bytes_read - written, *offset + written);
+        STATS_ADD(syscalls, 1);
+        if (result == -1) {
+            return -1;
+        }
+        written += result;
+    }
+    *offset += bytes_read;
+    return bytes_read;
+}
+
+/*!
+ * @brief copy_range copies a range of a file with sendfile, at the same offset in the destination
+ * With a digest, the data goes through a buffer instead, so that it is hashed while it is copied.
+ * @param source_fd is the source file descriptor
+ * @param dest_fd is the destination file descriptor
+ * @param offset is the start of the range
+ * @param length is the length of the range
+ * @param digest is the MD5 context fed with the range, NULL to copy without hashing
+ * @return 0 in case of success, -1 else
+ */
+static int copy_range(int source_fd, int dest_fd, off_t offset, off_t length, MD5_CTX *digest) {
+    if (lseek(dest_fd, offset, SEEK_SET) == -1) {
+        return -1;
+    }
+    off_t end = offset + length;
+    off_t previous_offset = offset, previous_length = 0;
+    // sendfile peut transférer moins que demandé (au plus ~2 Gio par appel)
+    while (offset < end) {
+        // Avec une limite de débit, la copie avance par morceaux pour partager le seau entre les processus
+        size_t chunk = end - offset;
+        if (ratelimit_enabled && chunk > RATELIMIT_CHUNK_SIZE) {
+            chunk = RATELIMIT_CHUNK_SIZE;
+        }
+        if (cache_neutral && chunk > CACHE_CHUNK_SIZE) {
+            chunk = CACHE_CHUNK_SIZE;
+        }
+        if (journal_enabled && chunk > JOURNAL_CHECKPOINT_BYTES) {
+            chunk = JOURNAL_CHECKPOINT_BYTES;
+        }
+        if (digest != NULL && chunk > HASHED_COPY_BUFFER_SIZE) {
+            chunk = HASHED_COPY_BUFFER_SIZE;
+        }
+        RATELIMIT(chunk);
+        off_t chunk_offset = offset;
+        ssize_t sent;
+        if (digest != NULL) {
+            sent = copy_chunk_hashed(source_fd, dest_fd, &offset, chunk, digest);
+        } else {
+            sent = sendfile(dest_fd, source_fd, &offset, chunk);
+            STATS_ADD(syscalls, 1);
+        }
+        if (sent == -1) {
+            return -1;
+        }
+        if (sent == 0) {
+            break; // Fichier source raccourci pendant la copie
+        }
+        JOURNAL_COPIED(dest_fd, offset);
+        // Mode neutre pour le cache : le morceau courant part sur le disque pendant que le précédent est libéré
+        cache_drop_read(source_fd, chunk_offset, sent);
+        cache_start_writeback(dest_fd, chunk_offset, sent);
+        if (previous_length > 0) {
+            cache_drop_written(dest_fd, previous_offset, previous_length);
+        }
+        previous_offset = chunk_offset;
+        previous_length = sent;
+    }
+    if (previous_length > 0) {
+        cache_drop_written(dest_fd, previous_offset, previous_length);
+    }
+    return 0;
+}
+
+/*!
+ * @brief copy_file_data copies the content of a file into an empty destination file
+ * Sparse files (fewer allocated blocks than their size) are copied extent by extent with SEEK_DATA and
+ * SEEK_HOLE: holes are skipped, so they are preserved in the destination and cost no I/O.
+ * @param source_fd is the source file descriptor
+ * @param dest_fd is the destination file descriptor (truncated, or holding the data before start)
+ * @param size is the size of the source file
+ * @param start is the offset to start from, when resuming an interrupted copy (@see journal_resume_offset)
+ * @param digest is the MD5 context receiving the whole content of the file, NULL to copy without hashing
+ * @return the number of bytes of data copied, -1 in case of error
+ */
+static off_t copy_file_data(int source_fd, int dest_fd, off_t size, off_t start, MD5_CTX *digest) {
+    struct stat info;
+    STATS_ADD(syscalls, 1);
+    if (fstat(source_fd, &info) == -1) {
+        return -1;
+    }
+    if (digest != NULL && start > 0 && hash_source_range(source_fd, 0, start, digest) == -1) {
+        return -1;
+    }
+    if ((off_t)info.st_blocks * 512 >= info.st_size && start == 0) {
+        return copy_range(source_fd, dest_fd, 0, size, digest) == -1 ? -1 : size;
+    }
+
+    // Les trous sont hachés comme les zéros qu'ils représentent
+    off_t copied = 0, data = start, hashed = start;
+    while (data < size) {
+        off_t position = data;
+        data = lseek(source_fd, position, SEEK_DATA);
+        STATS_ADD(syscalls, 1);
+        if (data == -1) {
+            if (errno == ENXIO) {
+                break; // Plus de données jusqu'à la fin : trou final
+            }
+            // SEEK_DATA non supporté : copie complète depuis le point de départ
+            if (copy_range(source_fd, dest_fd, position, size - position, digest) == -1) {
+                return -1;
+            }
+            copied += size - position;
+            hashed = size;
+            break;
+        }
+        off_t hole = lseek(source_fd, data, SEEK_HOLE);
+        STATS_ADD(syscalls, 1);
+        if (hole == -1 || hole > size) {
+            hole = size;
+        }
+        if (digest != NULL) {
+            hash_zeros(digest, data - hashed);
+        }
+        if (copy_range(source_fd, dest_fd, data, hole - data, digest) == -1) {
+            return -1;
+        }
+        copied += hole - data;
+        data = hashed = hole;
+    }
+    if (digest != NULL && hashed < size) {
+        hash_zeros(digest, size - hashed);
+    }
+    // La taille finale fixe le trou de fin de fichier
+    STATS_ADD(syscalls, 1);
+    if (ftruncate(dest_fd, size) == -1) {
+        return -1;
+    }
+    return copied;
+}
+
+/*!
+ * @brief copy_file_data_fan_out reads a file once and writes its content into several empty destination files
+ * Data goes through a FAN_OUT_BUFFER_SIZE buffer; holes of sparse files are skipped like in copy_file_data.
+ * @param source_fd is the source file descriptor
+ * @param dest_fds is the array of destination file descriptors (truncated)
+ * @param count is the number of destination file descriptors
+ * @param size is the size of the source file
+ * @param digest is the MD5 context receiving the whole content of the file, NULL to copy without hashing
+ * @return the number of bytes of data read (and written to each destination), -1 in case of error
+ */
+static off_t copy_file_data_fan_out(int source_fd, int *dest_fds, int count, off_t size, MD5_CTX *digest) {
+    struct stat info;
+    STATS_ADD(syscalls, 1);
+    if (fstat(source_fd, &info) == -1) {
+        return -1;
+    }
+    bool sparse = (off_t)info.st_blocks * 512 < info.st_size;
+    char *buffer = malloc(FAN_OUT_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return -1;
+    }
+
+    off_t copied = 0, data = 0, hashed = 0;
+    while (data < size) {
+        off_t hole = size;
+        if (sparse) {
+            off_t next_data = lseek(source_fd, data, SEEK_DATA);
+            STATS_ADD(syscalls, 1);
+            if (next_data == -1 && errno == ENXIO) {
+                break; // Trou final
+            }
+            if (next_data == -1) {
+                sparse = false; // SEEK_DATA non supporté : lecture complète
+            } else {
+                data = next_data;
+                hole = lseek(source_fd, data, SEEK_HOLE);
+                STATS_ADD(syscalls, 1);
+                if (hole == -1 || hole > size) {
+                    hole = size;
+                }
+            }
+        }
+        if (digest != NULL) {
+            hash_zeros(digest, data - hashed);
+            hashed = data;
+        }
+        while (data < hole) {
+            size_t chunk = hole - data > FAN_OUT_BUFFER_SIZE ? FAN_OUT_BUFFER_SIZE : hole - data;
+            ssize_t bytes_read = pread(source_fd, buffer, chunk, data);
+            STATS_ADD(syscalls, 1);
+            if (bytes_read <= 0) {
+                free(buffer);
+                return bytes_read == 0 ? copied : -1; // Fichier source raccourci pendant la copie
+            }
+            if (digest != NULL) {
+                MD5_Update(digest, buffer, bytes_read);
+                STATS_ADD(bytes_hashed, bytes_read);
+            }
+            // Une lecture, autant d'écritures que de destinations : la limite est comptée pour chacune
+            for (int i=0; i<count; ++i) {
+                RATELIMIT(bytes_read);
+                for (ssize_t written = 0; written < bytes_read; ) {
+                    ssize_t result = pwrite(dest_fds[i], buffer + written, bytes_read - written, data + written);
+                    STATS_ADD(syscalls, 1);
+                    if (result == -1) {
+                        free(buffer);
+                        return -1;
+                    }
+                    written += result;
+                }
+                cache_start_writeback(dest_fds[i], data, bytes_read);
+            }
+            cache_drop_read(source_fd, data, bytes_read);
+            data += bytes_read;
+            copied += bytes_read;
+            hashed = data;
+        }
+    }
+    free(buffer);
+    if (digest != NULL && hashed < size) {
+        hash_zeros(digest, size - hashed);
+    }
+
+    // La taille finale fixe le trou de fin de fichier
+    for (int i=0; i<count; ++i) {
+        STATS_ADD(syscalls, 1);
+        if (ftruncate(dest_fds[i], size) == -1) {
+            return -1;
+        }
+        cache_drop_written(dest_fds[i], 0, 0);
+    }
+    return copied;
+}
+
+/*!
+ * @brief link_existing_copy recreates a hard link towards a file already written in the destination
+ * @param source_entry is the source entry to copy
+ * @param destination_root is the root of the destination
+ * @param destination_file_path is the path of the entry in the destination
+ * @return true if the link was created (nothing left to copy), false else
+ */
+static bool link_existing_copy(files_list_entry_t *source_entry, char *destination_root, char *destination_file_path) {
+    const char *linked_path = hardlinks_find(source_entry);
+    char link_target[PATH_SIZE];
+    if (linked_path == NULL || concat_path(link_target, destination_root, (char *)linked_path) == NULL
+        || strcmp(link_target, destination_file_path) == 0) {
+        return false;
+    }
+    unlink(destination_file_path);
+    STATS_ADD(syscalls, 2);
+    if (link(link_target, destination_file_path) == 0) {
+        STATS_ADD(files_linked, 1);
+        return true;
+    }
+    // En fan-out, l'autre lien peut n'avoir été trouvé identique que dans une autre destination
+    if (errno != ENOENT) {
+        perror("Erreur dans la création du lien, le fichier est copié");
+    }
+    return false;
+}
+
 void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t *the_config) {
     // Vérifie si les paramètres passés sont valides
     if (source_entry == NULL || the_config == NULL) {
@@ -221,10 +1449,11 @@ void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t
         return;
     }
 
-    // Déclare et initialise les chemins source et destination avec les chemins du fichier source et de destination respectivement
-    char source_path[1024];
+    uint64_t copy_start = stats_begin();
+    TRACE_BEGIN("copy", "sync");
+
+    // Déclare et initialise le chemin destination (le chemin source de l'entrée est déjà complet)
     char dest_path[1024];
-    strcpy(source_path, the_config->source);
     strcpy(dest_path, the_config->destination);
 
     // Vérifie si l'entrée est un dossier
@@ -232,89 +1461,300 @@ void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t
         char directory[PATH_SIZE];
         // Construit le chemin du dossier à créer dans la destination
         concat_path(directory, dest_path, source_entry->path_and_name + strlen(the_config->source) + 1);
-        // Crée le dossier avec les permissions spécifiées dans source_entry->mode
-        if (mkdir(directory, source_entry->mode) != 0) {
+        // Crée le dossier (écrivable pour y copier son contenu), un dossier existant est conservé
+        STATS_ADD(syscalls, 1);
+        if (mkdir(directory, source_entry->mode | S_IRWXU) != 0 && errno != EEXIST) {
             perror("Erreur dans la création du dossier");
+            STATS_ADD(errors, 1);
+            TRACE_END("copy", "sync");
+            stats_end(PHASE_COPY, copy_start);
             return;
         }
+        // Mode et date appliqués une fois le contenu écrit (@see metadata_apply_directories)
+        metadata_defer_directory(directory, source_entry->mode, &source_entry->mtime);
     }
     else { // Si l'entrée est un fichier
         char source_file_path[PATH_SIZE];
         char destination_file_path[PATH_SIZE];
         // Construit les chemins complets des fichiers source et destination
-        concat_path(source_file_path, source_path, source_entry->path_and_name);
+        strncpy(source_file_path, source_entry->path_and_name, sizeof(source_file_path) - 1);
+        source_file_path[sizeof(source_file_path) - 1] = '\0';
         concat_path(destination_file_path, dest_path, source_entry->path_and_name + strlen(the_config->source) + 1);
 
+        // Petit fichier : ajouté au pack courant au lieu d'être créé dans la destination
+        if (pack_accepts(source_entry)) {
+            if (pack_store_file(source_entry, source_entry->path_and_name + strlen(the_config->source) + 1) == 0) {
+                STATS_ADD(files_copied, 1);
+                STATS_ADD(bytes_copied, source_entry->size);
+                journal_record_done(source_entry);
+            } else {
+                STATS_ADD(errors, 1);
+            }
+            TRACE_END("copy", "sync");
+            stats_end(PHASE_COPY, copy_start);
+            return;
+        }
+        // Fichier auparavant empaqueté, devenu trop grand : il redevient un fichier ordinaire
+        pack_forget(source_entry->path_and_name + strlen(the_config->source) + 1);
+
+        // Autre lien d'un inode déjà présent dans la destination : on recrée le lien au lieu de copier
+        if (link_existing_copy(source_entry, dest_path, destination_file_path)) {
+            journal_record_done(source_entry);
+            TRACE_END("copy", "sync");
+            stats_end(PHASE_COPY, copy_start);
+            return;
+        }
+
+        // Fichier déplacé dans la source : renommage dans la destination au lieu d'une copie
+        const char *moved_path = moves_find(source_entry);
+        if (moved_path != NULL) {
+            STATS_ADD(syscalls, 2);
+            if (rename(moved_path, destination_file_path) == 0) {
+                moves_done(source_entry);
+                journal_record_done(source_entry);
+                chmod(destination_file_path, source_entry->mode & 07777);
+                hardlinks_remember(source_entry, source_entry->path_and_name + strlen(the_config->source) + 1);
+                STATS_ADD(files_moved, 1);
+                TRACE_END("copy", "sync");
+                stats_end(PHASE_COPY, copy_start);
+                return;
+            }
+            perror("Erreur dans le déplacement du fichier, il est copié");
+        }
+
         // Ouvre le fichier source en lecture seule
         int source_fd = open(source_file_path, O_RDONLY);
+        STATS_ADD(syscalls, 1);
         if (source_fd == -1) {
             perror("Erreur dans l'ouverture du fichier");
+            STATS_ADD(errors, 1);
+            TRACE_END("copy", "sync");
+            stats_end(PHASE_COPY, copy_start);
             return;
         }
+        cache_advise_sequential(source_fd);
 
         // Ouvre ou crée le fichier destination avec les permissions spécifiées dans source_entry->mode
-        int dest_fd = open(destination_file_path, O_WRONLY | O_CREAT | O_TRUNC, source_entry->mode);
+        // Une copie interrompue (journal) est reprise : le début déjà écrit et synchronisé est conservé
+        off_t resume_offset = journal_resume_offset(source_entry);
+        int dest_fd = open(destination_file_path, O_WRONLY | O_CREAT | (resume_offset > 0 ? 0 : O_TRUNC), source_entry->mode);
+        STATS_ADD(syscalls, 1);
         if (dest_fd == -1) {
             perror("Erreur dans l'ouverture ou dans la création du fichier");
+            STATS_ADD(errors, 1);
             close(source_fd);
+            TRACE_END("copy", "sync");
+            stats_end(PHASE_COPY, copy_start);
             return;
         }
 
-        off_t offset = 0;
-        // Copie le contenu du fichier source vers le fichier destination en utilisant sendfile
-        off_t bytes_sent = sendfile(dest_fd, source_fd, &offset, source_entry->size);
+        struct stat dest_info;
+        if (resume_offset > 0 && (fstat(dest_fd, &dest_info) == -1 || dest_info.st_size < resume_offset)) {
+            // Fichier partiel disparu ou raccourci depuis : copie complète
+            resume_offset = 0;
+            ftruncate(dest_fd, 0);
+        }
+
+        // Copie le contenu du fichier source vers le fichier destination (seulement les données s'il est creux)
+        // Avec MD5 ou --verify, l'empreinte est calculée pendant la copie : la source n'est lue qu'une fois
+        bool hashing = the_config->uses_md5 || the_config->verify;
+        MD5_CTX digest;
+        MD5_Init(&digest);
+        journal_begin_file(source_entry, resume_offset);
+        off_t bytes_sent = copy_file_data(source_fd, dest_fd, source_entry->size, resume_offset, hashing ? &digest : NULL);
         if (bytes_sent == -1) {
             perror("Erreur dans la copie du fichier");
+            STATS_ADD(errors, 1);
+            journal_end_file(dest_fd, false);
+        } else {
+            STATS_ADD(files_copied, 1);
+            STATS_ADD(bytes_copied, bytes_sent);
+            // Empreinte conservée dans l'entrée (et donc dans le manifeste) pour les prochaines exécutions
+            if (hashing) {
+                MD5_Final(source_entry->md5sum, &digest);
+                STATS_ADD(files_hashed, 1);
+            }
+            if (the_config->verify) {
+                verify_record(destination_file_path, source_entry->md5sum);
+            }
+            // Mode et date de la source, pour que le fichier ne soit pas vu modifié à la prochaine exécution
+            metadata_apply_fd(dest_fd, source_entry->mode, &source_entry->mtime);
+            durability_file_written(dest_fd, bytes_sent);
+            hardlinks_remember(source_entry, source_entry->path_and_name + strlen(the_config->source) + 1);
+            journal_end_file(dest_fd, true);
         }
 
         // Ferme les descripteurs de fichier
         close(source_fd);
         close(dest_fd);
     }
+    TRACE_END("copy", "sync");
+    stats_end(PHASE_COPY, copy_start);
 }
 
 
 
 /*!
- * @brief make_list lists files in a location (it recurses in directories)
- * It doesn't get files properties, only a list of paths
- * This function is used by make_files_list and make_files_list_parallel
- * @param list is a pointer to the list that will be built
- * @param target is the target dir whose content must be listed
+ * @brief copy_entry_to_destinations copies a source entry into several destinations, reading it only once
+ * Directories, and files needed by a single destination, go through copy_entry_to_destination.
+ * @param source_entry is the source entry to copy
+ * @param configs is an array of configurations, one per destination needing the entry
+ * @param count is the number of destinations
  */
-void make_list(files_list_t *list, const char *target) {
+void copy_entry_to_destinations(files_list_entry_t *source_entry, configuration_t **configs, int count) {
+    if (source_entry == NULL || configs == NULL || count <= 0) {
+        printf("Paramètres invalides\n");
+        return;
+    }
+    if (count == 1 || source_entry->entry_type == DOSSIER) {
+        for (int i=0; i<count; ++i) {
+            copy_entry_to_destination(source_entry, configs[i]);
+        }
+        return;
+    }
 
-  // Vérification des paramètres passés
-  if (list == NULL || target == NULL) {
-    printf("Paramètres invalides\n");
-    return;
-  }
+    uint64_t copy_start = stats_begin();
+    TRACE_BEGIN("copy", "sync");
+    char *relative_path = source_entry->path_and_name + strlen(configs[0]->source) + 1;
 
-  // Vérification de l'existence du répertoire cible
-  if (!directory_exists(target)) {
-    return;
-  }
+    // Ouverture des copies à écrire, après recréation des liens possibles
+    int dest_fds[1 + MAX_EXTRA_DESTINATIONS];
+    char dest_paths[1 + MAX_EXTRA_DESTINATIONS][PATH_SIZE];
+    int written_count = 0;
+    for (int i=0; i<count; ++i) {
+        char destination_file_path[PATH_SIZE];
+        if (concat_path(destination_file_path, configs[i]->destination, relative_path) == NULL
+            || link_existing_copy(source_entry, configs[i]->destination, destination_file_path)) {
+            continue;
+        }
+        int dest_fd = open(destination_file_path, O_WRONLY | O_CREAT | O_TRUNC, source_entry->mode);
+        STATS_ADD(syscalls, 1);
+        if (dest_fd == -1) {
+            perror("Erreur dans l'ouverture ou dans la création du fichier");
+            STATS_ADD(errors, 1);
+            continue;
+        }
+        strcpy(dest_paths[written_count], destination_file_path);
+        dest_fds[written_count++] = dest_fd;
+    }
+
+    int source_fd = written_count > 0 ? open(source_entry->path_and_name, O_RDONLY) : -1;
+    if (written_count > 0) {
+        STATS_ADD(syscalls, 1);
+        if (source_fd == -1) {
+            perror("Erreur dans l'ouverture du fichier");
+            STATS_ADD(errors, 1);
+        } else {
+            cache_advise_sequential(source_fd);
+            bool hashing = configs[0]->uses_md5 || configs[0]->verify;
+            MD5_CTX digest;
+            MD5_Init(&digest);
+            off_t bytes_sent = written_count == 1
+                ? copy_file_data(source_fd, dest_fds[0], source_entry->size, 0, hashing ? &digest : NULL)
+                : copy_file_data_fan_out(source_fd, dest_fds, written_count, source_entry->size, hashing ? &digest : NULL);
+            if (bytes_sent == -1) {
+                perror("Erreur dans la copie du fichier");
+                STATS_ADD(errors, 1);
+            } else {
+                if (hashing) {
+                    MD5_Final(source_entry->md5sum, &digest);
+                    STATS_ADD(files_hashed, 1);
+                }
+                for (int i=0; i<written_count; ++i) {
+                    STATS_ADD(files_copied, 1);
+                    STATS_ADD(bytes_copied, bytes_sent);
+                    if (configs[0]->verify) {
+                        verify_record(dest_paths[i], source_entry->md5sum);
+                    }
+                    metadata_apply_fd(dest_fds[i], source_entry->mode, &source_entry->mtime);
+                    durability_file_written(dest_fds[i], bytes_sent);
+                }
+                hardlinks_remember(source_entry, relative_path);
+            }
+            close(source_fd);
+        }
+    }
+    for (int i=0; i<written_count; ++i) {
+        close(dest_fds[i]);
+    }
+    TRACE_END("copy", "sync");
+    stats_end(PHASE_COPY, copy_start);
+}
+
+/*!
+ * @brief list_tree lists a directory of a tree recursively, skipping the entries excluded by the filters
+ * Excluded directories are pruned: they are neither stat'ed nor opened.
+ * @param list is a pointer to the list that will be built
+ * @param target is the directory to list
+ * @param root_length is the length of the path of the root of the tree, to get relative paths
+ */
+static void list_tree(files_list_t *list, const char *target, size_t root_length) {
 
   // Ouverture du répertoire cible
+  TRACE_BEGIN("scan_dir", "list");
   DIR *dir = open_dir(target);
+  STATS_ADD(syscalls, 1);
 
   // Récupération des entrées du répertoire
   struct dirent *entry;
   while ((entry = readdir(dir)) != NULL) {
+      STATS_ADD(entries_listed, 1);
+      // . et .. ne sont pas des entrées de l'arborescence
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+          continue;
+      }
+      // Dossier des packs d'une destination : son contenu est décrit par l'index (@see pack_add_to_list)
+      if (strlen(target) == root_length && strcmp(entry->d_name, PACK_DIRECTORY_NAME) == 0) {
+          continue;
+      }
       // Construction du chemin complet du fichier
       char file_path[4096];
       snprintf(file_path, sizeof(file_path), "%s/%s", target, entry->d_name);
+      // Filtres évalués sur le type donné par readdir, avant tout stat (lstat si le système de fichiers ne le donne pas)
+      bool is_directory = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN) {
+          struct stat info;
+          STATS_ADD(syscalls, 1);
+          is_directory = lstat(file_path, &info) == 0 && S_ISDIR(info.st_mode);
+      }
+      if (filter_excluded(file_path + root_length + 1, is_directory)) {
+          continue;
+      }
       // Ajout du chemin à la liste chainée
       add_file_entry(list, file_path);
 
       // Si l'entrée est un dossier, récursion pour lister son contenu
-      if (entry->d_type == DT_DIR && strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) { 
-          make_list(list, file_path); 
+      if (is_directory) {
+          list_tree(list, file_path, root_length);
       }
   }
 
   // Fermeture du répertoire
   closedir(dir);
+  TRACE_END("scan_dir", "list");
+}
+
+/*!
+ * @brief make_list lists files in a location (it recurses in directories)
+ * It doesn't get files properties, only a list of paths
+ * This function is used by make_files_list and make_files_list_parallel
+ * @param list is a pointer to the list that will be built
+ * @param target is the target dir whose content must be listed
+ */
+void make_list(files_list_t *list, const char *target) {
+
+  // Vérification des paramètres passés
+  if (list == NULL || target == NULL) {
+    printf("Paramètres invalides\n");
+    return;
+  }
+
+  // Vérification de l'existence du répertoire cible
+  if (!directory_exists(target)) {
+    return;
+  }
+
+  list_tree(list, target, strlen(target));
 }
 
 
@@ -323,7 +1763,7 @@ void make_list(files_list_t *list, const char *target) {
  * @param path is the path to the dir
  * @return a pointer to a dir, NULL if it cannot be opened
  */
-DIR *open_dir(char *path) {
+DIR *open_dir(const char *path) {
   // Vérification si le répertoire existe
   if (!directory_exists(path)) {
       return NULL;
@@ -6,11 +6,17 @@
 #include <processes.h>
 #include <dirent.h>
 
+// Size of the buffer through which a file is read once and written to several destinations
+#define FAN_OUT_BUFFER_SIZE (1024 * 1024)
+// Copies that hash the data on the way (MD5 or --verify) go through a buffer of this size instead of sendfile
+#define HASHED_COPY_BUFFER_SIZE (1024 * 1024)
+
 void synchronize(configuration_t *the_config, process_context_t *p_context);
 void make_files_list(files_list_t *list, char *target_path);
 bool mismatch(files_list_entry_t *lhd, files_list_entry_t *rhd, bool has_md5);
 void make_files_lists_parallel(files_list_t *src_list, files_list_t *dst_list, configuration_t *the_config, int msg_queue);
 void copy_entry_to_destination(files_list_entry_t *source_entry, configuration_t *the_config);
+void copy_entry_to_destinations(files_list_entry_t *source_entry, configuration_t **configs, int count);
 void make_list(files_list_t *list, char *target);
-DIR *open_dir(char *path);
+DIR *open_dir(const char *path);
 struct dirent *get_next_entry(DIR *dir);
\ No newline at end of file
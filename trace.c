@@ -0,0 +1,183 @@
+#include <trace.h>
+#include <stats.h>
+#include <defines.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <libgen.h>
+
+#define TRACE_BUFFER_EVENTS 4096
+
+typedef struct {
+    const char *name; // Chaînes statiques uniquement : pas de copie sur le chemin critique
+    const char *category;
+    uint64_t timestamp_ns;
+    char phase;
+} trace_event_t;
+
+bool trace_enabled = false;
+
+static char trace_path[PATH_SIZE];
+static char process_name[32] = "main";
+static trace_event_t trace_buffer[TRACE_BUFFER_EVENTS];
+static int trace_buffer_count = 0;
+static bool process_name_written = false;
+
+/*!
+ * @brief trace_part_path builds the path of the calling process' part file
+ * @param result is the buffer receiving the path (PATH_SIZE bytes)
+ * @param pid is the process id whose part file is wanted
+ * @return 0 in case of success, -1 if the path does not fit (truncated, it could be shared by several processes)
+ */
+static int trace_part_path(char *result, pid_t pid) {
+    return snprintf(result, PATH_SIZE, "%s.part.%d", trace_path, (int)pid) < PATH_SIZE ? 0 : -1;
+}
+
+/*!
+ * @brief trace_init enables tracing, must be called by the main process before any fork
+ * @param path is the path of the Chrome trace JSON file to write at exit, NULL or empty to disable tracing
+ * @return 0 in case of success, -1 else
+ */
+int trace_init(const char *path) {
+    if (path == NULL || path[0] == '\0') {
+        return 0;
+    }
+    if (strlen(path) + 32 > PATH_SIZE) {
+        fprintf(stderr, "Chemin de trace trop long\n");
+        return -1;
+    }
+    strcpy(trace_path, path);
+    trace_enabled = true;
+    trace_attach_process("main");
+    return 0;
+}
+
+/*!
+ * @brief trace_attach_process resets the buffer inherited from the parent, called by a child right after fork
+ * @param name is the name of the process as displayed in the trace viewer
+ */
+void trace_attach_process(const char *name) {
+    if (!trace_enabled) {
+        return;
+    }
+    strncpy(process_name, name, sizeof(process_name) - 1);
+    trace_buffer_count = 0;
+    process_name_written = false;
+}
+
+/*!
+ * @brief trace_event records an event in the process buffer, flushing it to the part file when full
+ * Use the TRACE_BEGIN and TRACE_END macros, that cost a single test when tracing is disabled.
+ * @param name is a static string naming the event
+ * @param category is a static string for the event category
+ * @param phase is 'B' for begin and 'E' for end
+ */
+void trace_event(const char *name, const char *category, char phase) {
+    if (trace_buffer_count == TRACE_BUFFER_EVENTS) {
+        trace_flush();
+    }
+    trace_event_t *event = &trace_buffer[trace_buffer_count++];
+    event->name = name;
+    event->category = category;
+    event->phase = phase;
+    event->timestamp_ns = stats_now();
+}
+
+/*!
+ * @brief trace_flush appends the buffered events of the calling process to its part file
+ * Each process writes its own file, so no synchronization is needed between processes.
+ */
+void trace_flush(void) {
+    if (!trace_enabled || (trace_buffer_count == 0 && process_name_written)) {
+        return;
+    }
+
+    pid_t pid = getpid();
+    char part_path[PATH_SIZE];
+    if (trace_part_path(part_path, pid) == -1) {
+        fprintf(stderr, "Chemin de trace trop long : trace désactivée\n");
+        trace_enabled = false;
+        trace_buffer_count = 0;
+        return;
+    }
+    FILE *part = fopen(part_path, "a");
+    if (part == NULL) {
+        perror("Erreur lors de l'écriture de la trace");
+        trace_buffer_count = 0;
+        return;
+    }
+
+    if (!process_name_written) {
+        fprintf(part, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %d, \"args\": {\"name\": \"%s\"}}\n",
+                (int)pid, (int)pid, process_name);
+        process_name_written = true;
+    }
+    for (int i=0; i<trace_buffer_count; ++i) {
+        trace_event_t *event = &trace_buffer[i];
+        fprintf(part, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d}\n",
+                event->name, event->category, event->phase, event->timestamp_ns / 1000.0, (int)pid, (int)pid);
+    }
+    fclose(part);
+    trace_buffer_count = 0;
+}
+
+/*!
+ * @brief trace_merge merges the part files of all processes into the final Chrome trace JSON
+ * Must be called by the main process once its children have terminated.
+ * @return 0 in case of success (or tracing disabled), -1 else
+ */
+int trace_merge(void) {
+    if (!trace_enabled) {
+        return 0;
+    }
+    trace_flush();
+
+    char directory_path[PATH_SIZE], base_path[PATH_SIZE];
+    strcpy(directory_path, trace_path);
+    strcpy(base_path, trace_path);
+    char *directory_name = dirname(directory_path);
+    char part_prefix[PATH_SIZE];
+    snprintf(part_prefix, sizeof(part_prefix), "%s.part.", basename(base_path));
+
+    FILE *output = fopen(trace_path, "w");
+    if (output == NULL) {
+        perror("Erreur lors de la création de la trace");
+        return -1;
+    }
+    DIR *dir = opendir(directory_name);
+    if (dir == NULL) {
+        perror("Erreur lors de la lecture des traces partielles");
+        fclose(output);
+        return -1;
+    }
+
+    fprintf(output, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    bool first = true;
+    struct dirent *entry;
+    char line[512];
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, part_prefix, strlen(part_prefix)) != 0) {
+            continue;
+        }
+        char part_path[PATH_SIZE];
+        snprintf(part_path, sizeof(part_path), "%s/%s", directory_name, entry->d_name);
+        FILE *part = fopen(part_path, "r");
+        if (part == NULL) {
+            continue;
+        }
+        // Chaque ligne est un événement complet : il suffit de les séparer par des virgules
+        while (fgets(line, sizeof(line), part) != NULL) {
+            line[strcspn(line, "\n")] = '\0';
+            fprintf(output, "%s%s", first ? "" : ",\n", line);
+            first = false;
+        }
+        fclose(part);
+        unlink(part_path);
+    }
+    fprintf(output, "\n]}\n");
+    closedir(dir);
+    fclose(output);
+    return 0;
+}
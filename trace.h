@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdbool.h>
+
+extern bool trace_enabled;
+
+#define TRACE_BEGIN(name, category) do { if (trace_enabled) trace_event(name, category, 'B'); } while (0)
+#define TRACE_END(name, category) do { if (trace_enabled) trace_event(name, category, 'E'); } while (0)
+
+int trace_init(const char *trace_path);
+void trace_attach_process(const char *process_name);
+void trace_event(const char *name, const char *category, char phase);
+void trace_flush(void);
+int trace_merge(void);
@@ -0,0 +1,155 @@
+#define _GNU_SOURCE // sched_getaffinity
+#include <tuning.h>
+#include <defines.h>
+#include <remote.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+bool tuning_enabled = false;
+// Bornes et nombre courant de processus actifs, conservé d'un groupe de processus au suivant
+static uint32_t minimum_workers = 1;
+static uint32_t maximum_workers = 1;
+static uint32_t active_workers = 1;
+// Montée de colline : débit de la mesure précédente et sens du dernier changement
+static uint64_t previous_rate = 0;
+static int direction = 1;
+
+/*!
+ * @brief count_cores returns the number of CPUs the process may run on
+ */
+static uint32_t count_cores(void) {
+    cpu_set_t cpus;
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) > 0) {
+        return CPU_COUNT(&cpus);
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (uint32_t)online : 1;
+}
+
+/*!
+ * @brief is_rotational tells if the block device holding a path is a rotating disk (sysfs)
+ * A partition has no queue directory: the queue of its parent disk is used.
+ * @param path is a path on the device
+ * @return 1 for a rotating disk, 0 for a solid state device, -1 if unknown (no block device: tmpfs, NFS...)
+ */
+static int is_rotational(const char *path) {
+    struct stat info;
+    char device_path[PATH_SIZE], resolved[PATH_SIZE];
+    if (stat(path, &info) == -1) {
+        return -1;
+    }
+    snprintf(device_path, sizeof(device_path), "/sys/dev/block/%u:%u", major(info.st_dev), minor(info.st_dev));
+    if (realpath(device_path, resolved) == NULL) {
+        return -1;
+    }
+    for (int level=0; level<2; ++level) {
+        char rotational_path[PATH_SIZE + 32];
+        snprintf(rotational_path, sizeof(rotational_path), "%s/queue/rotational", resolved);
+        FILE *file = fopen(rotational_path, "r");
+        if (file != NULL) {
+            int value = fgetc(file);
+            fclose(file);
+            return value == '1';
+        }
+        char *separator = strrchr(resolved, '/');
+        if (separator == NULL) {
+            break;
+        }
+        *separator = '\0';
+    }
+    return -1;
+}
+
+/*!
+ * @brief rotational_name describes the result of is_rotational
+ */
+static const char *rotational_name(int rotational) {
+    return rotational == 1 ? "disque rotatif" : rotational == 0 ? "SSD" : "inconnu";
+}
+
+/*!
+ * @brief tuning_init chooses the bounds of the number of workers (-n auto) from the machine and the devices
+ * Hashing is bound by the CPU on solid state devices: up to two workers per core. On a rotating disk,
+ * concurrent readers make the heads seek: at most two workers, and files are read in disk order
+ * (@see diskorder_sort). The starting count is then adapted to the measured throughput (@see tuning_adjust).
+ * @param the_config is a pointer to the configuration, its processes_count receives the starting count
+ * @return 0 in case of success, -1 else
+ */
+int tuning_init(configuration_t *the_config) {
+    if (!the_config->auto_processes) {
+        return 0;
+    }
+    uint32_t cores = count_cores();
+    int source_rotational = is_rotational(the_config->source);
+    int destination_rotational = remote_is_address(the_config->destination) ? -1 : is_rotational(the_config->destination);
+
+    minimum_workers = 1;
+    if (source_rotational == 1 || destination_rotational == 1) {
+        maximum_workers = 2;
+        active_workers = 1;
+        // Sur disque rotatif, l'ordre physique des lectures compte plus que le nombre de processus
+        the_config->disk_order = true;
+    } else {
+        maximum_workers = 2 * cores;
+        active_workers = cores;
+    }
+    if (maximum_workers > MAX_PROCESSES_COUNT) {
+        maximum_workers = MAX_PROCESSES_COUNT;
+    }
+    if (active_workers > maximum_workers) {
+        active_workers = maximum_workers;
+    }
+    previous_rate = 0;
+    direction = 1;
+    tuning_enabled = maximum_workers > 1;
+    the_config->processes_count = (uint16_t)active_workers;
+    printf("Réglage automatique : %u coeurs, source sur %s, destination sur %s, de %u à %u processus (départ à %u)\n",
+           cores, rotational_name(source_rotational), rotational_name(destination_rotational),
+           minimum_workers, maximum_workers, active_workers);
+    return 0;
+}
+
+/*!
+ * @brief tuning_maximum_workers returns the number of workers to start in a pool (some may stay idle)
+ */
+uint32_t tuning_maximum_workers(void) {
+    return maximum_workers;
+}
+
+/*!
+ * @brief tuning_active_workers returns the number of workers that currently take work
+ */
+uint32_t tuning_active_workers(void) {
+    return active_workers;
+}
+
+/*!
+ * @brief tuning_adjust adapts the number of active workers to the throughput measured since the last call
+ * Hill climbing: the count keeps moving in the same direction while the throughput improves, turns back
+ * when it drops, and stays when the change is within TUNING_TOLERANCE_PERCENT.
+ * @param bytes_per_second is the throughput measured over the last period
+ * @return the new number of active workers
+ */
+uint32_t tuning_adjust(uint64_t bytes_per_second) {
+    if (previous_rate > 0) {
+        uint64_t tolerance = previous_rate * TUNING_TOLERANCE_PERCENT / 100;
+        if (bytes_per_second + tolerance < previous_rate) {
+            direction = -direction;
+        } else if (bytes_per_second <= previous_rate + tolerance) {
+            previous_rate = bytes_per_second;
+            return active_workers;
+        }
+    }
+    previous_rate = bytes_per_second;
+    if (direction > 0 && active_workers < maximum_workers) {
+        active_workers++;
+    } else if (direction < 0 && active_workers > minimum_workers) {
+        active_workers--;
+    }
+    return active_workers;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <configuration.h>
+
+// Throughput is measured over this period before the number of active workers is changed
+#define TUNING_SAMPLE_NS 250000000ULL
+// Changes of throughput smaller than this (in percent) are noise: the number of workers is kept
+#define TUNING_TOLERANCE_PERCENT 5
+
+extern bool tuning_enabled;
+
+int tuning_init(configuration_t *the_config);
+uint32_t tuning_maximum_workers(void);
+uint32_t tuning_active_workers(void);
+uint32_t tuning_adjust(uint64_t bytes_per_second);
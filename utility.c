@@ -1,5 +1,8 @@
 #include <defines.h>
 #include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
 
 /*!
  * @brief concat_path concatenates suffix to prefix into result
@@ -34,3 +37,33 @@ char *concat_path(char *result, char *prefix, char *suffix) {
 
     return result;
 }
+
+/*!
+ * @brief parse_size converts a size with an optional binary suffix (K, M, G, T) into bytes
+ * @param text is the string to convert, e.g. "512M"
+ * @return the size in bytes, -1 if the string is not a valid size
+ */
+int64_t parse_size(const char *text) {
+    if (text == NULL || *text == '\0') {
+        return -1;
+    }
+    char *end;
+    errno = 0;
+    long long value = strtoll(text, &end, 10);
+    if (errno != 0 || value < 0 || end == text) {
+        return -1;
+    }
+    int shift = 0;
+    switch (*end) {
+        case '\0': break;
+        case 'k': case 'K': shift = 10; end++; break;
+        case 'm': case 'M': shift = 20; end++; break;
+        case 'g': case 'G': shift = 30; end++; break;
+        case 't': case 'T': shift = 40; end++; break;
+        default: return -1;
+    }
+    if (*end != '\0' || value > (INT64_MAX >> shift)) {
+        return -1;
+    }
+    return (int64_t)value << shift;
+}
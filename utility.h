@@ -1,5 +1,7 @@
 #pragma once
 
 #include <defines.h>
+#include <stdint.h>
 
-char *concat_path(char *result, char *prefix, char *suffix);
\ No newline at end of file
+char *concat_path(char *result, char *prefix, char *suffix);
+int64_t parse_size(const char *text);
@@ -0,0 +1,108 @@
+#include <verify.h>
+#include <defines.h>
+#include <files-list.h>
+#include <file-properties.h>
+#include <stats.h>
+#include <trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Copies relues par lots : seuls les lots en cours ont une entrée complète (chemin de PATH_SIZE octets)
+#define VERIFY_BATCH_SIZE 1024
+
+typedef struct {
+    char *path;
+    uint8_t md5sum[16];
+} verified_copy_t;
+
+// Copies écrites pendant cette exécution, avec l'empreinte calculée pendant leur copie
+static verified_copy_t *copies = NULL;
+static size_t copies_count = 0;
+static size_t copies_capacity = 0;
+
+/*!
+ * @brief verify_record records a copy to verify once the synchronization is done (--verify)
+ * @param destination_path is the path of the written copy
+ * @param md5sum is the MD5 sum of the data, computed while it was copied
+ * @return 0 in case of success, -1 else
+ */
+int verify_record(const char *destination_path, const uint8_t md5sum[16]) {
+    if (copies_count == copies_capacity) {
+        size_t capacity = copies_capacity ? copies_capacity * 2 : 64;
+        verified_copy_t *resized = realloc(copies, capacity * sizeof(verified_copy_t));
+        if (resized == NULL) {
+            printf("Erreur d'allocation mémoire\n");
+            return -1;
+        }
+        copies = resized;
+        copies_capacity = capacity;
+    }
+    char *path = strdup(destination_path);
+    if (path == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        return -1;
+    }
+    copies[copies_count].path = path;
+    memcpy(copies[copies_count].md5sum, md5sum, 16);
+    copies_count++;
+    return 0;
+}
+
+/*!
+ * @brief verify_run reads back all the recorded copies and compares their MD5 sums with the copied data
+ * Copies are read in parallel by the hashing processes, bypassing the page cache, so that the data
+ * actually stored is checked rather than the pages that were just written.
+ * @param workers_count is the number of hashing processes
+ * @return the number of copies that differ or could not be read, -1 if the verification could not run
+ */
+int verify_run(int workers_count) {
+    if (copies_count == 0) {
+        return 0;
+    }
+    files_list_entry_t *batch = malloc(VERIFY_BATCH_SIZE * sizeof(files_list_entry_t));
+    files_list_entry_t **entries = malloc(VERIFY_BATCH_SIZE * sizeof(files_list_entry_t *));
+    if (batch == NULL || entries == NULL) {
+        printf("Erreur d'allocation mémoire\n");
+        free(batch);
+        free(entries);
+        return -1;
+    }
+
+    TRACE_BEGIN("verify", "sync");
+    int failures = 0;
+    for (size_t first=0; first<copies_count; first+=VERIFY_BATCH_SIZE) {
+        size_t count = copies_count - first < VERIFY_BATCH_SIZE ? copies_count - first : VERIFY_BATCH_SIZE;
+        for (size_t i=0; i<count; ++i) {
+            memset(&batch[i], 0, sizeof(files_list_entry_t));
+            strncpy(batch[i].path_and_name, copies[first + i].path, sizeof(batch[i].path_and_name) - 1);
+            batch[i].entry_type = FICHIER;
+            entries[i] = &batch[i];
+        }
+        compute_files_md5_parallel(entries, count, workers_count, HASH_DIRECT);
+        for (size_t i=0; i<count; ++i) {
+            if (memcmp(batch[i].md5sum, copies[first + i].md5sum, 16) != 0) {
+                printf("Vérification échouée : %s\n", batch[i].path_and_name);
+                STATS_ADD(errors, 1);
+                failures++;
+            }
+        }
+    }
+    TRACE_END("verify", "sync");
+    printf("Vérification : %zu copies relues, %d différentes\n", copies_count, failures);
+    free(batch);
+    free(entries);
+    return failures;
+}
+
+/*!
+ * @brief verify_clear forgets the recorded copies
+ */
+void verify_clear(void) {
+    for (size_t i=0; i<copies_count; ++i) {
+        free(copies[i].path);
+    }
+    free(copies);
+    copies = NULL;
+    copies_count = copies_capacity = 0;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+int verify_record(const char *destination_path, const uint8_t md5sum[16]);
+int verify_run(int workers_count);
+void verify_clear(void);